@@ -4,10 +4,13 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct rb_node;
+struct rb_root;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct sysstat;
 
 // bio.c
 void binit(void);
@@ -63,6 +66,7 @@ void ramdiskrw(struct buf *);
 void *kalloc(void);
 void kfree(void *);
 void kinit(void);
+int kfreepages(void);
 
 // log.c
 void initlog(int, struct superblock *);
@@ -86,7 +90,6 @@ int cpuid(void);
 void exit(int, char *);
 int fork(void);
 int growproc(int);
-void proc_mapstacks(pagetable_t);
 pagetable_t proc_pagetable(struct proc *);
 void proc_freepagetable(pagetable_t, uint64);
 int kill(int);
@@ -106,16 +109,38 @@ void yield(void);
 int either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void procdump(void);
-void update_timers(void);              // task 6
-long long get_vruntime(struct proc *); // task 6
-long long get_min_vruntime();          // task 6
+int charge_tick(struct proc *);         // task 6
 void set_ps_priority(int);             // task 5
 int set_cfs_priority(int);             // task 6
 int get_cfs_priority(int, uint64);     // task 6
 int set_policy(int);                   // task 7
-void default_scheduler(void);
-void ps_scheduler(void);
-void cfs_scheduler(void);
+int set_affinity(int, uint64);
+int get_affinity(int, uint64 *);
+int get_procs(uint64, int);
+int set_edf(int, int, int);
+void edf_tick(void);
+int sleep_until(uint);
+void hrtimer_intr(void);
+int sleep_ticks(int);
+int usleep(uint64);
+void timer_tick(void);
+int create_group(int);
+int set_group_weight(int, int);
+int nr_running(void);
+void procstats(struct sysstat *);
+int set_tickets(int);
+void lend_tickets(int);
+void return_tickets(void);
+int pi_boost(struct sleeplock *);
+void pi_restore(void);
+int need_resched(void);
+
+// rbtree.c
+void rb_insert(struct rb_root *, struct rb_node *,
+               int (*)(struct rb_node *, struct rb_node *));
+void rb_erase(struct rb_root *, struct rb_node *);
+struct rb_node *rb_first(struct rb_root *);
+struct rb_node *rb_next(struct rb_node *);
 
 // swtch.S
 void swtch(struct context *, struct context *);
@@ -151,6 +176,10 @@ int fetchstr(uint64, char *, int);
 int fetchaddr(uint64, uint64 *);
 void syscall();
 
+// stats.c
+void statsinit(void);
+void load_tick(void);
+
 // trap.c
 extern uint ticks;
 void trapinit(void);
@@ -158,6 +187,10 @@ void trapinithart(void);
 extern struct spinlock tickslock;
 void usertrapret(void);
 
+// trace.c
+void traceinit(void);
+void tracerecord(int, int, int, long long, int);
+
 // uart.c
 void uartinit(void);
 void uartintr(void);
@@ -166,6 +199,7 @@ void uartputc_sync(int);
 int uartgetc(void);
 
 // vm.c
+extern pagetable_t kernel_pagetable;
 void kvminit(void);
 void kvminithart(void);
 void kvmmap(pagetable_t, uint64, uint64, uint64, int);
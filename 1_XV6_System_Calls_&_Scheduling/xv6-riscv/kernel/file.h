@@ -38,3 +38,5 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define SCHEDTRACE 2
+#define STATS 3
@@ -27,6 +27,8 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    traceinit();     // scheduler event tracing
+    statsinit();     // load and utilisation device
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
@@ -27,8 +27,10 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // software interrupt pending
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define TIMER_SCRATCH 10 // words of timer_scratch[] per hart, see start.c
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
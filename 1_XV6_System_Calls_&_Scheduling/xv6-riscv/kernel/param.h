@@ -1,5 +1,9 @@
-#define NPROC        64  // maximum number of processes
+#define PROC_PAGES   16  // pages of memory per process when sizing the process table
+#define NHEAPDIR     16  // pages of ps heap slots per run queue; bounds the process table
 #define NCPU          8  // maximum number of CPUs
+#define NGROUP       16  // cfs process groups
+#define MLFQ_LEVELS   4  // queue levels of the mlfq policy
+#define NPOLICY       5  // scheduling policies: rr, ps, cfs, mlfq, stride
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -11,3 +15,4 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICK_CYCLES  1000000 // r_time() cycles per clock tick; about 1/10th second in qemu
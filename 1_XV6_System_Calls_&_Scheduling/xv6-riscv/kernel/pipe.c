@@ -3,6 +3,7 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "rbtree.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
@@ -17,6 +18,8 @@ struct pipe {
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rpid;       // last process to read, or 0
+  int wpid;       // last process to write, or 0
 };
 
 int
@@ -34,6 +37,7 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->rpid = pi->wpid = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -80,6 +84,7 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
+  pi->wpid = pr->pid;
   while(i < n){
     if(pi->readopen == 0 || killed(pr)){
       release(&pi->lock);
@@ -87,7 +92,10 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
       wakeup(&pi->nread);
+      // the reader is what we wait for; lend it our tickets.
+      lend_tickets(pi->rpid);
       sleep(&pi->nwrite, &pi->lock);
+      return_tickets();
     } else {
       char ch;
       if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
@@ -110,12 +118,16 @@ piperead(struct pipe *pi, uint64 addr, int n)
   char ch;
 
   acquire(&pi->lock);
+  pi->rpid = pr->pid;
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(killed(pr)){
       release(&pi->lock);
       return -1;
     }
+    // the writer is what we wait for; lend it our tickets.
+    lend_tickets(pi->wpid);
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    return_tickets();
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
@@ -3,163 +3,1263 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "rbtree.h"
 #include "proc.h"
 #include "defs.h"
+#include "trace.h"
+#include "pstat.h"
+#include "stats.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Process descriptors come from a slab cache: whole pages
+// carved into struct procs, each given a kernel stack mapped
+// at KSTACK(its slot) when its page is carved. Descriptors are
+// never given back to kalloc(), so a stale struct proc pointer
+// still points at a struct proc, and its locks stay valid.
+// Lock order: ptable.lock, then p->lock.
+struct
+{
+  struct spinlock lock;
+  struct proc *free; // unused descriptors, linked by all_next
+  struct proc *live; // allocated ones, linked by all_next/all_prev
+  int nproc;         // descriptors on live
+  int nslot;         // descriptors carved so far
+} ptable;
+
+// Most processes that may exist at once, set at boot from the
+// memory there is: PROC_PAGES pages per process.
+int maxproc;
+
+// Bumped when a kernel stack is mapped; a hart seeing a new
+// value flushes its TLB before running a process.
+uint kstack_gen;
 
 struct proc *initproc;
 
 int nextpid = 1;
 struct spinlock pid_lock;
+
+// Live processes hashed by pid, chained through p->pid_next.
+// pids are handed out in sequence, so the low bits spread
+// them evenly. Lock order: p->lock, then pid_lock.
+#define NPIDHASH 64 // a power of two
+#define PIDHASH(pid) ((pid) & (NPIDHASH - 1))
+struct proc *pidhash[NPIDHASH]; // guarded by pid_lock
+
+// Sleeping processes are kept on one of NSLEEPQ queues,
+// chosen by hashing the channel, so wakeup() only looks at
+// processes that sleep on a channel with the same hash.
+// Lock order: sleepq lock, then p->lock.
+#define SLEEPQ_SHIFT 6
+#define NSLEEPQ (1 << SLEEPQ_SHIFT)
+
+struct sleepq
+{
+  struct spinlock lock;
+  struct proc *head; // linked by sq_next/sq_prev
+} sleepq[NSLEEPQ];
+
+// Processes in sleep_until() wait on a hashed timer wheel:
+// one waiting for tick t is on slot t % NTWSLOT, so each tick
+// only looks at the processes due then, plus those a whole
+// revolution or more further out. Lock order: timerwheel.lock,
+// then the sleepq locks.
+#define NTWSLOT 256
+
+struct
+{
+  struct spinlock lock;
+  struct proc *slot[NTWSLOT]; // linked by tw_next/tw_prev
+} timerwheel;
+
 /////////TASK7/////////
-// 0: default_scheduler
-// 1:      ps_scheduler
-// 2:     cfs_scheduler
+// The policy set_policy() chose. There is one scheduler() for
+// all of them; it only decides how rq_insert(), rq_remove() and
+// rq_pop() order each hart's run queue:
+// 0: round robin, in arrival order
+// 1: ps, min accumulator first, on a heap
+// 2: cfs, min vruntime first, per group, in red-black trees
+// 3: mlfq, round robin within the highest non-empty level
+// 4: stride, min pass first, on the same heap as ps
+// EDF processes with budget left wait on edf_rq, above them all.
 int curr_sched_policy = 0;
 struct spinlock policy_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void update_timers(struct proc *p);
+static void child_link(struct proc **head, struct proc *p);
+static void group_put(int g);
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
+// Each process p has its own p->wait_lock, which guards the
+// lists of its children and the parent field of each child,
+// and ensures that wakeups of p in wait() are not lost.
+// Lock order: a process's wait_lock before initproc's, and
+// any wait_lock before any p->lock. exit() takes its own and
+// its parent's one after the other, never both at once.
+
+// Per-CPU run queues.
+// A RUNNABLE process is either on exactly one hart's run queue
+// or has just been taken off one by the hart about to run it.
+// Processes are queued on the hart that makes them RUNNABLE
+// (the forking, waking or yielding hart); an idle hart steals
+// from the busiest queue and every hart periodically pulls work
+// from the busiest queue to even out the load.
+// lock order: p->lock, then rq->lock. Only set_policy() and
+// rq_balance() hold more than one rq->lock, and take them in
+// cpus[] order.
+
+#define BALANCE_INTERVAL 10 // ticks between load balancing passes
+
+// Harts that have entered scheduler(), one bit per hart.
+uint64 online_cpus;
+
+// Earliest-deadline-first class, above whatever set_policy()
+// chose. A process admitted by set_edf() gets edf_runtime ticks
+// of CPU in every edf_period, to be used by edf_deadline ticks
+// after the period starts. While the current job has budget
+// left the process waits on edf_rq, shared by all harts and
+// ordered by deadline, and every hart looks there before its
+// own queue; once the budget is spent it is throttled and runs
+// as an ordinary process until edf_tick() starts its next job.
+// Admission keeps the summed runtime/deadline of all EDF
+// processes at or below 1, so all of them fit on one hart.
+// lock order: edf_lock, then p->lock, then edf_rq.lock.
+#define EDF_POLICY -1 // how rq_insert() and friends sort edf_rq
+#define EDF_SHIFT  16 // bandwidth 1 << EDF_SHIFT is a whole hart
+
+struct runq edf_rq;
+struct spinlock edf_lock;
+struct proc *edf_list;  // every EDF process, linked by edf_next
+uint64 edf_bw;          // sum of their edf_bw
+
+// Does p have an EDF job with budget left to run?
+static int
+edf_eligible(struct proc *p)
+{
+  return p->edf_runtime > 0 && p->edf_budget > 0;
+}
 
-// Added for Task5
-// gets the minimum value of the accumulators of
-// all the runnable/running processes
-long long
-get_min_acc()
+// May p run on hart id? id < 0 means any hart.
+static int
+cpu_allowed(struct proc *p, int id)
 {
-  long long min_acc = 0;
-  struct proc *p;
+  return id < 0 || ((p->cpumask >> id) & 1);
+}
+
+// Task6: vruntime is kept in fixed point, 1 << VRUNTIME_SHIFT
+// being one tick of a cfs_priority 1 process.
+#define VRUNTIME_SHIFT 10
+
+// vruntime charged per tick of CPU for cfs_priority 0, 1 and 2
+// (decay factors 0.75, 1 and 1.25).
+static const long long cfs_decay[] = {
+    (75 << VRUNTIME_SHIFT) / 100,
+    (100 << VRUNTIME_SHIFT) / 100,
+    (125 << VRUNTIME_SHIFT) / 100};
+
+// How far behind the queue's min_vruntime a woken process may
+// be placed, so sleepers get a small head start but cannot
+// bank the time they spent asleep.
+#define WAKEUP_CREDIT (1 << VRUNTIME_SHIFT)
+
+// How far a woken process's vruntime must be below the running
+// one's for it to preempt, so the two do not ping-pong.
+#define WAKEUP_GRAN (WAKEUP_CREDIT / 2)
+
+// The stride policy gives each process a share of its hart in
+// proportion to its tickets: every tick it runs adds
+// STRIDE1 / tickets to its pass, and the lowest pass runs next.
+// A process is queued no lower than the queue's min_pass, so
+// it banks no credit while asleep or away on another hart.
+// Tickets lent by processes waiting on p (see lend_tickets())
+// count as p's own.
+#define STRIDE1 (1 << 20)
+#define STRIDE_TICKETS 100 // tickets of a new process
+#define STRIDE_MAX_TICKETS 10000
+
+// Task5: the ps policy keeps each queue in a binary min-heap
+// ordered by accumulator, then by enqueue order, so equal
+// accumulators are served FIFO. heap_idx lets a queued process
+// be removed or re-sorted in place. The stride policy uses
+// the same heap, ordered by pass.
+static int
+heap_less(struct proc *a, struct proc *b)
+{
+  long long ka = curr_sched_policy == 4 ? a->pass : a->accumulator;
+  long long kb = curr_sched_policy == 4 ? b->pass : b->accumulator;
+
+  if (ka != kb)
+    return ka < kb;
+  return a->rq_seq < b->rq_seq;
+}
+
+// The heap lives in pages of HEAP_PER_PAGE slots, allocated
+// by heap_reserve() as the number of processes grows.
+#define HEAP_PER_PAGE (PGSIZE / sizeof(struct proc *))
+#define HEAPSLOT(rq, i) ((rq)->heap[(i) / HEAP_PER_PAGE][(i) % HEAP_PER_PAGE])
+
+// Make sure every run queue's heap has room for n processes.
+// Returns -1 if out of memory.
+static int
+heap_reserve(int n)
+{
+  int d = (n - 1) / HEAP_PER_PAGE;
+  struct cpu *c;
+  void *pg;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (c = cpus; c < &cpus[NCPU]; c++)
   {
-    acquire(&p->lock);
-    if ((p->state == RUNNING || p->state == RUNNABLE))
+    if (c->rq.heap[d])
+      continue;
+    if ((pg = kalloc()) == 0)
+      return -1;
+    acquire(&c->rq.lock);
+    if (c->rq.heap[d] == 0)
     {
-      if (min_acc == 0)
-        min_acc = p->accumulator;
-      else if (p->accumulator < min_acc)
-        min_acc = p->accumulator;
+      c->rq.heap[d] = pg;
+      pg = 0;
     }
-    release(&p->lock);
+    release(&c->rq.lock);
+    if (pg)
+      kfree(pg);
   }
-  return min_acc;
+  return 0;
 }
 
-void update_timers()
+static void
+heap_set(struct runq *rq, int i, struct proc *p)
 {
-  struct proc *p;
+  HEAPSLOT(rq, i) = p;
+  p->heap_idx = i;
+}
+
+// Restore the heap order around slot i of a heap of n entries.
+static void
+heap_fix(struct runq *rq, int i, int n)
+{
+  struct proc *p = HEAPSLOT(rq, i);
+  int child;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  while (i > 0 && heap_less(p, HEAPSLOT(rq, (i - 1) / 2)))
   {
-    acquire(&p->lock);
-    if ((p->state == RUNNING))
+    heap_set(rq, i, HEAPSLOT(rq, (i - 1) / 2));
+    i = (i - 1) / 2;
+  }
+  while ((child = 2 * i + 1) < n)
+  {
+    if (child + 1 < n && heap_less(HEAPSLOT(rq, child + 1), HEAPSLOT(rq, child)))
+      child++;
+    if (!heap_less(HEAPSLOT(rq, child), p))
+      break;
+    heap_set(rq, i, HEAPSLOT(rq, child));
+    i = child;
+  }
+  heap_set(rq, i, p);
+}
+
+// The mlfq policy keeps MLFQ_LEVELS round-robin lists per
+// queue and runs from the highest non-empty level. A process
+// starts at level 0 and drops a level once it has used up
+// the level's allotment of MLFQ_SLICE ticks, which is also its
+// time slice there; sleeping does not reset the count, so
+// blocking just before the slice ends gains nothing. Every
+// MLFQ_BOOST ticks all processes return to level 0, so CPU
+// hogs at the bottom cannot starve.
+#define MLFQ_SLICE(l) (1 << (l))
+#define MLFQ_BOOST    50
+
+// Put p back at level 0 if a boost happened since its level
+// was set. p must be running or being queued.
+static void
+mlfq_refresh(struct proc *p)
+{
+  uint epoch = ticks / MLFQ_BOOST;
+
+  if (p->mlfq_epoch != epoch)
+  {
+    p->mlfq_level = 0;
+    p->mlfq_used = 0;
+    p->mlfq_epoch = epoch;
+  }
+}
+
+static void
+list_append(struct proc **head, struct proc **tail, struct proc *p)
+{
+  p->rq_next = 0;
+  p->rq_prev = *tail;
+  if (*tail)
+    (*tail)->rq_next = p;
+  else
+    *head = p;
+  *tail = p;
+}
+
+static void
+list_remove(struct proc **head, struct proc **tail, struct proc *p)
+{
+  if (p->rq_prev)
+    p->rq_prev->rq_next = p->rq_next;
+  else
+    *head = p->rq_next;
+  if (p->rq_next)
+    p->rq_next->rq_prev = p->rq_prev;
+  else
+    *tail = p->rq_prev;
+}
+
+static int
+edf_less(struct rb_node *a, struct rb_node *b)
+{
+  struct proc *pa = rb_entry(a, struct proc, rq_node);
+  struct proc *pb = rb_entry(b, struct proc, rq_node);
+
+  if (pa->edf_dl != pb->edf_dl)
+    return (int)(pa->edf_dl - pb->edf_dl) < 0;
+  return pa->rq_seq < pb->rq_seq;
+}
+
+static int
+cfs_less(struct rb_node *a, struct rb_node *b)
+{
+  struct proc *pa = rb_entry(a, struct proc, rq_node);
+  struct proc *pb = rb_entry(b, struct proc, rq_node);
+
+  if (pa->vruntime != pb->vruntime)
+    return pa->vruntime < pb->vruntime;
+  return pa->rq_seq < pb->rq_seq;
+}
+
+// cfs is hierarchical: each run queue's tree holds the groups
+// with processes queued there, ordered by the group's vruntime
+// on that hart, and each group keeps its queued processes in a
+// tree of its own, ordered by their vruntime. A group's
+// vruntime grows by GROUP_WEIGHT / weight per tick that any
+// member runs, so groups share a hart by weight no matter how
+// many processes each has.
+#define GROUP_WEIGHT 1024 // weight of a new group, and the most a group may have
+
+struct pgroup groups[NGROUP]; // groups[0] holds every process at first
+struct spinlock group_lock;   // guards nproc and weight
+
+static int
+group_less(struct rb_node *a, struct rb_node *b)
+{
+  struct gsched *ga = rb_entry(a, struct gsched, node);
+  struct gsched *gb = rb_entry(b, struct gsched, node);
+
+  if (ga->vruntime != gb->vruntime)
+    return ga->vruntime < gb->vruntime;
+  return ga->seq < gb->seq;
+}
+
+// p's group's state on the hart that owns rq.
+static struct gsched *
+group_se(struct runq *rq, struct proc *p)
+{
+  return &groups[p->group].se[rq->id];
+}
+
+// Add p to its group's tree on rq, queueing the group on rq
+// if it had no one there. A group that was idle on this hart
+// starts no further behind than min_gvruntime.
+// rq->lock must be held.
+static void
+group_insert(struct runq *rq, struct proc *p)
+{
+  struct gsched *ge = group_se(rq, p);
+
+  rb_insert(&ge->tree, &p->rq_node, cfs_less);
+  if (ge->nr++ == 0)
+  {
+    if (ge->vruntime < rq->min_gvruntime)
+      ge->vruntime = rq->min_gvruntime;
+    ge->seq = p->rq_seq;
+    rb_insert(&rq->tree, &ge->node, group_less);
+  }
+}
+
+// rq->lock must be held.
+static void
+group_remove(struct runq *rq, struct proc *p)
+{
+  struct gsched *ge = group_se(rq, p);
+
+  rb_erase(&ge->tree, &p->rq_node);
+  if (--ge->nr == 0)
+    rb_erase(&rq->tree, &ge->node);
+}
+
+// Apply the group vruntime p ran up on hart c to its group's
+// state there, re-sorting the group if it is queued.
+// Caller must hold p->lock.
+static void
+group_charge(struct cpu *c, struct proc *p)
+{
+  struct gsched *ge = group_se(&c->rq, p);
+
+  if (p->gdelta == 0)
+    return;
+  acquire(&c->rq.lock);
+  if (ge->nr > 0)
+  {
+    rb_erase(&c->rq.tree, &ge->node);
+    ge->vruntime += p->gdelta;
+    rb_insert(&c->rq.tree, &ge->node, group_less);
+  }
+  else
+  {
+    ge->vruntime += p->gdelta;
+  }
+  release(&c->rq.lock);
+  p->gdelta = 0;
+}
+
+// The policy rq is kept in order for: the current one, except
+// that edf_rq is always kept by deadline.
+static int
+rq_policy(struct runq *rq)
+{
+  return rq == &edf_rq ? EDF_POLICY : curr_sched_policy;
+}
+
+// Add p to rq in the structure the current policy dispatches from.
+// rq->lock must be held.
+static void
+rq_insert(struct runq *rq, struct proc *p)
+{
+  p->rq_seq = rq->seq++;
+  switch (rq_policy(rq))
+  {
+  case EDF_POLICY:
+    rb_insert(&rq->tree, &p->rq_node, edf_less);
+    break;
+  case 4:
+    if (p->pass < rq->min_pass)
+      p->pass = rq->min_pass;
+    // fall through
+  case 1:
+    heap_set(rq, rq->nr, p);
+    heap_fix(rq, rq->nr, rq->nr + 1);
+    break;
+  case 2:
+    group_insert(rq, p);
+    break;
+  case 3:
+    mlfq_refresh(p);
+    list_append(&rq->mlfq_head[p->mlfq_level], &rq->mlfq_tail[p->mlfq_level], p);
+    rq->mlfq_mask |= 1 << p->mlfq_level;
+    break;
+  default:
+    list_append(&rq->head, &rq->tail, p);
+    break;
+  }
+  p->rq = rq;
+  rq->nr++;
+}
+
+// rq->lock must be held.
+static void
+rq_remove(struct runq *rq, struct proc *p)
+{
+  switch (rq_policy(rq))
+  {
+  case EDF_POLICY:
+    rb_erase(&rq->tree, &p->rq_node);
+    break;
+  case 2:
+    group_remove(rq, p);
+    break;
+  case 1:
+  case 4:
+    if (p->heap_idx != rq->nr - 1)
     {
-      p->rtime = p->rtime + 1;
+      heap_set(rq, p->heap_idx, HEAPSLOT(rq, rq->nr - 1));
+      heap_fix(rq, p->heap_idx, rq->nr - 1);
     }
-    else if ((p->state == RUNNABLE))
+    break;
+  case 3:
+    list_remove(&rq->mlfq_head[p->mlfq_level], &rq->mlfq_tail[p->mlfq_level], p);
+    if (rq->mlfq_head[p->mlfq_level] == 0)
+      rq->mlfq_mask &= ~(1 << p->mlfq_level);
+    break;
+  default:
+    list_remove(&rq->head, &rq->tail, p);
+    break;
+  }
+  p->rq = 0;
+  rq->nr--;
+}
+
+// Take the process the current policy would run next on hart
+// id off rq, skipping processes whose affinity excludes id.
+// The front of the queue is always allowed when id owns rq, so
+// only stealing ever skips. Returns 0 if there is none.
+// rq->lock must be held.
+static struct proc *
+rq_pop(struct runq *rq, int id)
+{
+  struct proc *p, *best = 0;
+  struct rb_node *n, *gn;
+  struct gsched *ge = 0;
+  int i;
+
+  switch (rq_policy(rq))
+  {
+  case EDF_POLICY:
+    // edf: earliest deadline.
+    for (n = rb_first(&rq->tree); n; n = rb_next(n))
+    {
+      p = rb_entry(n, struct proc, rq_node);
+      if (cpu_allowed(p, id))
+      {
+        best = p;
+        break;
+      }
+    }
+    break;
+  case 1:
+  case 4:
+    // ps: min accumulator, stride: min pass; earliest queued
+    // on ties.
+    if (rq->nr > 0 && cpu_allowed(HEAPSLOT(rq, 0), id))
+      best = HEAPSLOT(rq, 0);
+    else
+    {
+      for (i = 0; i < rq->nr; i++)
+      {
+        p = HEAPSLOT(rq, i);
+        if (cpu_allowed(p, id) && (best == 0 || heap_less(p, best)))
+          best = p;
+      }
+    }
+    // the queue's virtual time moves on however best was found.
+    if (best && best->pass > rq->min_pass)
+      rq->min_pass = best->pass;
+    break;
+  case 2:
+    // cfs: the group with min vruntime, then its process
+    // with min vruntime.
+    for (gn = rb_first(&rq->tree); gn && best == 0; gn = rb_next(gn))
     {
-      p->retime = p->retime + 1;
+      ge = rb_entry(gn, struct gsched, node);
+      for (n = rb_first(&ge->tree); n; n = rb_next(n))
+      {
+        p = rb_entry(n, struct proc, rq_node);
+        if (cpu_allowed(p, id))
+        {
+          best = p;
+          break;
+        }
+      }
     }
-    else if ((p->state == SLEEPING))
+    if (best && ge == rb_entry(rb_first(&rq->tree), struct gsched, node))
     {
-      p->stime = p->stime + 1;
+      if (ge->vruntime > rq->min_gvruntime)
+        rq->min_gvruntime = ge->vruntime;
+      if (n == rb_first(&ge->tree) && best->vruntime > rq->min_vruntime)
+        rq->min_vruntime = best->vruntime;
     }
+    break;
+  case 3:
+    // mlfq: round robin within the highest non-empty level.
+    for (i = 0; i < MLFQ_LEVELS && best == 0; i++)
+      if (rq->mlfq_mask & (1 << i))
+        for (best = rq->mlfq_head[i]; best && !cpu_allowed(best, id); best = best->rq_next)
+          ;
+    break;
+  default:
+    // round robin.
+    for (best = rq->head; best && !cpu_allowed(best, id); best = best->rq_next)
+      ;
+    break;
+  }
+  if (best)
+    rq_remove(rq, best);
+  return best;
+}
+
+// Record a scheduler event for p in this hart's trace ring.
+static void
+trace(int type, struct proc *p, int arg)
+{
+  int policy = curr_sched_policy;
+
+  tracerecord(type, p->pid, policy,
+              policy == 2 ? p->vruntime : policy == 4 ? p->pass : p->accumulator, arg);
+}
+
+// Choose the run queue p should wait on: this hart's if p may
+// run here, else the one of the hart p last ran on if allowed,
+// else that of the first online hart p may run on.
+static struct runq *
+rq_select(struct proc *p)
+{
+  int id = cpuid();
+  uint64 allowed = p->cpumask & online_cpus;
+
+  if (allowed == 0 || (allowed & (1L << id)))
+    return &cpus[id].rq;
+  if (allowed & (1L << p->cpu))
+    return &cpus[p->cpu].rq;
+  for (id = 0; (allowed & (1L << id)) == 0; id++)
+    ;
+  return &cpus[id].rq;
+}
+
+// Send an IPI to hart id, ending its wfi if it is idle.
+static void
+cpukick(int id)
+{
+  *(volatile uint32 *)CLINT_MSIP(id) = 1;
+}
+
+// p was just queued on rq. If the hart that owns rq is idle,
+// kick it; otherwise kick some idle hart p may run on, which
+// will steal p. The release of rq->lock orders our enqueue
+// before reading the idle flags; cpu_idle() publishes the flag
+// before its last look at the queues, so one side sees the other.
+// Returns 1 if an idle hart will pick p up.
+static int
+kick_idle(struct proc *p, struct runq *rq)
+{
+  int self = cpuid();
+  int owner;
+  int id;
+
+  // edf_rq has no owner; any hart may take p from it.
+  if (rq != &edf_rq && cpus[owner = rq->id].idle)
+  {
+    if (owner != self)
+      cpukick(owner);
+    return 1;
+  }
+  for (id = 0; id < NCPU; id++)
+  {
+    if (id != self && cpus[id].idle && cpu_allowed(p, id))
+    {
+      cpukick(id);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Should p, just queued on hart id's run queue, run before
+// cur, which that hart is running? Reads cur without its lock,
+// so the answer is a hint.
+static int
+should_preempt(struct proc *p, struct proc *cur, int id)
+{
+  struct gsched *pg, *cg;
+
+  if (edf_eligible(cur))
+    return 0;
+  switch (curr_sched_policy)
+  {
+  case 1:
+    return p->accumulator < cur->accumulator;
+  case 2:
+    if (p->group != cur->group)
+    {
+      pg = &groups[p->group].se[id];
+      cg = &groups[cur->group].se[id];
+      return pg->vruntime + WAKEUP_GRAN < cg->vruntime + cur->gdelta;
+    }
+    return p->vruntime + WAKEUP_GRAN < cur->vruntime;
+  case 3:
+    return p->mlfq_level < cur->mlfq_level;
+  case 4:
+    return p->pass < cur->pass;
+  default:
+    return 0;
+  }
+}
+
+// Ask hart id to switch processes as soon as it takes an
+// interrupt; for this hart, when the current trap returns.
+static void
+resched_cpu(int id)
+{
+  cpus[id].need_resched = 1;
+  if (id != cpuid())
+    cpukick(id);
+}
+
+// p was just woken onto rq and no idle hart will take it. If
+// it should beat the process running on the hart that owns rq,
+// preempt that process. For edf_rq, preempt one hart p may use:
+// the first running a process with no EDF job, else the one
+// whose EDF job has the latest deadline after p's.
+static void
+wakeup_preempt(struct proc *p, struct runq *rq)
+{
+  struct proc *cur;
+  int id, victim = -1;
+  uint dl = p->edf_dl;
+
+  if (rq != &edf_rq)
+  {
+    id = rq->id;
+    if ((cur = cpus[id].proc) != 0 && cur != p && should_preempt(p, cur, id))
+      resched_cpu(id);
+    return;
+  }
+  for (id = 0; id < NCPU; id++)
+  {
+    if (((online_cpus >> id) & 1) == 0 || !cpu_allowed(p, id) ||
+        (cur = cpus[id].proc) == 0 || cur == p)
+      continue;
+    if (!edf_eligible(cur))
+    {
+      victim = id;
+      break;
+    }
+    if ((int)(cur->edf_dl - dl) > 0)
+    {
+      victim = id;
+      dl = cur->edf_dl;
+    }
+  }
+  if (victim >= 0)
+    resched_cpu(victim);
+}
+
+// Has a wakeup asked this hart to switch processes?
+int need_resched(void)
+{
+  int r;
+
+  push_off();
+  r = mycpu()->need_resched;
+  pop_off();
+  return r;
+}
+
+// Make p RUNNABLE and queue it on edf_rq if it has an EDF job
+// to run, else on this hart, or on one p's affinity allows.
+// A new process starts at the queue's min_vruntime; a woken
+// one keeps the lead or lag it had when it went to sleep,
+// but no more than WAKEUP_CREDIT of lead.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq = edf_eligible(p) ? &edf_rq : rq_select(p);
+  int woken = p->state != RUNNING;
+  long long min_vruntime;
+
+  acquire(&rq->lock);
+  // edf_rq keeps no min_vruntime; place p against this hart's,
+  // as sleep() does.
+  min_vruntime = rq == &edf_rq ? mycpu()->rq.min_vruntime : rq->min_vruntime;
+  if (p->state == USED)
+  {
+    p->vruntime = min_vruntime;
+  }
+  else if (p->state == SLEEPING)
+  {
+    p->vruntime += min_vruntime;
+    if (p->vruntime < min_vruntime - WAKEUP_CREDIT)
+      p->vruntime = min_vruntime - WAKEUP_CREDIT;
+  }
+  if (p->state == USED)
+    trace(TRACE_FORK, p, 0);
+  else if (p->state == SLEEPING)
+    trace(TRACE_WAKEUP, p, 0);
+  update_timers(p);
+  p->state = RUNNABLE;
+  rq_insert(rq, p);
+  release(&rq->lock);
+
+  // a yielding process stays with its hart; there is no
+  // point waking another one to take it.
+  if (woken && !kick_idle(p, rq))
+    wakeup_preempt(p, rq);
+}
+
+// p's EDF job was started or ended; if p is waiting on a run
+// queue, move it to the one setrunnable() would now choose.
+// Caller must hold p->lock.
+static void
+edf_requeue(struct proc *p)
+{
+  struct runq *rq = p->rq;
+
+  if (p->state != RUNNABLE || rq == 0)
+    return;
+  acquire(&rq->lock);
+  // a hart may have taken p off the queue to run it meanwhile.
+  if (p->rq != rq)
+  {
+    release(&rq->lock);
+    return;
+  }
+  rq_remove(rq, p);
+  release(&rq->lock);
+
+  rq = edf_eligible(p) ? &edf_rq : rq_select(p);
+  acquire(&rq->lock);
+  rq_insert(rq, p);
+  release(&rq->lock);
+  if (!kick_idle(p, rq))
+    wakeup_preempt(p, rq);
+}
+
+// Called on every clock tick. Ends each EDF job whose deadline
+// has come, counting a miss if it still wanted the CPU, and
+// starts a new job for each process whose period has begun.
+void edf_tick(void)
+{
+  struct proc *p;
+  uint now = ticks;
+  int changed;
+
+  acquire(&edf_lock);
+  for (p = edf_list; p; p = p->edf_next)
+  {
+    acquire(&p->lock);
+    changed = 0;
+    if (p->edf_budget > 0 && (int)(now - p->edf_dl) >= 0)
+    {
+      if (p->state == RUNNABLE || p->state == RUNNING)
+        p->edf_misses++;
+      p->edf_budget = 0;
+      changed = 1;
+    }
+    if ((int)(now - p->edf_release) >= 0)
+    {
+      p->edf_dl = p->edf_release + p->edf_deadline;
+      p->edf_release += p->edf_period;
+      p->edf_budget = p->edf_runtime;
+      changed = 1;
+    }
+    if (changed)
+      edf_requeue(p);
     release(&p->lock);
   }
+  release(&edf_lock);
 }
 
-// Added for Task6
-// get vruntime of a specific process
+// Take the process hart c should run next from the queues it
+// serves: edf_rq, then its own run queue. Returns 0 if both
+// have nothing c may run.
+static struct proc *
+rq_pick(struct cpu *c)
+{
+  struct proc *p = 0;
+
+  if (edf_rq.nr > 0)
+  {
+    acquire(&edf_rq.lock);
+    p = rq_pop(&edf_rq, c - cpus);
+    release(&edf_rq.lock);
+  }
+  if (p == 0)
+  {
+    acquire(&c->rq.lock);
+    p = rq_pop(&c->rq, c - cpus);
+    release(&c->rq.lock);
+  }
+  return p;
+}
+
+// Return the run queue with the most waiting processes,
+// other than this hart's, or 0 if they are all empty.
+// Reads the counts without locks; it is only a hint.
+static struct runq *
+rq_busiest(struct cpu *c)
+{
+  struct cpu *oc;
+  struct runq *busiest = 0;
+
+  for (oc = cpus; oc < &cpus[NCPU]; oc++)
+  {
+    if (oc == c)
+      continue;
+    if (oc->rq.nr > 0 && (busiest == 0 || oc->rq.nr > busiest->nr))
+      busiest = &oc->rq;
+  }
+  return busiest;
+}
+
+// Our run queue is empty: take the process that the
+// busiest hart would have run next.
+static struct proc *
+rq_steal(struct cpu *c)
+{
+  struct runq *rq;
+  struct proc *p;
+
+  if ((rq = rq_busiest(c)) == 0)
+    return 0;
+  acquire(&rq->lock);
+  if ((p = rq_pop(rq, c - cpus)) != 0)
+    p->vruntime += c->rq.min_vruntime - rq->min_vruntime;
+  release(&rq->lock);
+  return p;
+}
+
+// Every BALANCE_INTERVAL ticks, pull half of the difference
+// between the busiest queue and ours onto this hart. Both
+// queues are locked, lower hart first, so each process goes
+// straight from one to the other and is never RUNNABLE off
+// every queue without a hart about to run it.
+static void
+rq_balance(struct cpu *c)
+{
+  struct runq *rq;
+  struct proc *p;
+  int n;
+
+  if (ticks - c->last_balance < BALANCE_INTERVAL)
+    return;
+  c->last_balance = ticks;
+
+  if ((rq = rq_busiest(c)) == 0)
+    return;
+  if (rq->id < c->rq.id)
+  {
+    acquire(&rq->lock);
+    acquire(&c->rq.lock);
+  }
+  else
+  {
+    acquire(&c->rq.lock);
+    acquire(&rq->lock);
+  }
+  for (n = (rq->nr - c->rq.nr) / 2; n > 0 && (p = rq_pop(rq, c - cpus)) != 0; n--)
+  {
+    p->vruntime += c->rq.min_vruntime - rq->min_vruntime;
+    rq_insert(&c->rq, p);
+  }
+  release(&rq->lock);
+  release(&c->rq.lock);
+}
+
+// Lower *min to p's accumulator if p is the first seen or less.
+static void
+acc_min(struct proc *p, long long *min, int *found)
+{
+  if (!*found || p->accumulator < *min)
+    *min = p->accumulator;
+  *found = 1;
+}
+
+// The least accumulator among the processes queued on rq, in
+// *min if found or less than it; sets *found. Under ps that is
+// the heap's front; under the other policies the accumulators
+// are not what rq is sorted by, so every queued process is
+// looked at. rq->lock must be held.
+static void
+rq_min_acc(struct runq *rq, long long *min, int *found)
+{
+  struct rb_node *n, *gn;
+  struct proc *p;
+  int i, l, nheap = 0;
+
+  switch (rq_policy(rq))
+  {
+  case 1:
+    nheap = rq->nr > 0;
+    break;
+  case 4:
+    nheap = rq->nr;
+    break;
+  case EDF_POLICY:
+    for (n = rb_first(&rq->tree); n; n = rb_next(n))
+      acc_min(rb_entry(n, struct proc, rq_node), min, found);
+    return;
+  case 2:
+    for (gn = rb_first(&rq->tree); gn; gn = rb_next(gn))
+      for (n = rb_first(&rb_entry(gn, struct gsched, node)->tree); n; n = rb_next(n))
+        acc_min(rb_entry(n, struct proc, rq_node), min, found);
+    return;
+  case 3:
+    for (l = 0; l < MLFQ_LEVELS; l++)
+      for (p = rq->mlfq_head[l]; p; p = p->rq_next)
+        acc_min(p, min, found);
+    return;
+  default:
+    for (p = rq->head; p; p = p->rq_next)
+      acc_min(p, min, found);
+    return;
+  }
+  for (i = 0; i < nheap; i++)
+    acc_min(HEAPSLOT(rq, i), min, found);
+}
+
+// Added for Task5
+// gets the minimum value of the accumulators of
+// all the runnable/running processes, or 0 if there are none.
+// Looks at each run queue and at what each hart is running,
+// so it costs O(NCPU) under the ps policy and is linear in
+// the queued processes under the others.
 long long
-get_vruntime(struct proc *p)
+get_min_acc()
+{
+  long long min_acc = 0;
+  int found = 0;
+  struct proc *p;
+  struct cpu *c;
+
+  acquire(&edf_rq.lock);
+  rq_min_acc(&edf_rq, &min_acc, &found);
+  release(&edf_rq.lock);
+  for (c = cpus; c < &cpus[NCPU]; c++)
+  {
+    acquire(&c->rq.lock);
+    rq_min_acc(&c->rq, &min_acc, &found);
+    release(&c->rq.lock);
+
+    // racy, like procdump(): c->proc may be switching.
+    if ((p = c->proc) != 0)
+      acc_min(p, &min_acc, &found);
+  }
+  return min_acc;
+}
+
+// Added for Task6
+// Charge the ticks p has spent in its current state since it
+// entered it to rtime, retime or stime. Called on every state
+// change, so the timers cost nothing per tick.
+// Caller must hold p->lock.
+static void
+update_timers(struct proc *p)
 {
-  long long vruntime;
-  int decay_factor = 0;
-  switch (p->cfs_priority)
+  uint now = ticks;
+
+  switch (p->state)
+  {
+  case RUNNING:
+    p->rtime += now - p->state_ticks;
+    break;
+  case RUNNABLE:
+    p->retime += now - p->state_ticks;
+    break;
+  case SLEEPING:
+    p->stime += now - p->state_ticks;
+    break;
+  default:
+    break;
+  }
+  p->state_ticks = now;
+}
+
+// Ticks p may run before the timer path reconsiders: a fixed
+// slice under round robin, longer for favoured ps and cfs
+// priorities, and what is left of the level's allotment
+// under mlfq. Stride re-sorts on every tick.
+#define RR_SLICE 1
+
+static int
+time_slice(struct proc *p)
+{
+  int n;
+
+  switch (curr_sched_policy)
+  {
+  case 1:
+    n = 1 + (10 - p->ps_priority) / 4; // ps_priority 1..10: 3..1
+    return n < 1 ? 1 : n > 3 ? 3 : n;
+  case 2:
+    return 3 - p->cfs_priority; // cfs_priority 0..2: 3..1
+  case 3:
+    return MLFQ_SLICE(p->mlfq_level) - p->mlfq_used;
+  default:
+    return RR_SLICE;
+  }
+}
+
+// Is c due a load balancing pass that would pull work?
+static int
+balance_due(struct cpu *c)
+{
+  struct runq *rq;
+
+  return ticks - c->last_balance >= BALANCE_INTERVAL &&
+         (rq = rq_busiest(c)) != 0 && rq->nr - c->rq.nr > 1;
+}
+
+// Added for Task6
+// Charge the running process p for the clock tick that just
+// ended on this hart: the accumulator grows by the ps priority,
+// vruntime by the cfs weight and pass by the stride, so all
+// stay O(1) per tick.
+// An EDF process also spends a tick of its job's budget.
+// Returns 1 if p should give up the hart: its EDF budget ran
+// out, a higher mlfq level has work, or its time slice is used
+// up and something else could run here. A released EDF job is
+// not checked for here; wakeup_preempt() preempts the one hart
+// that should run it.
+// Otherwise p keeps the hart, with a fresh slice if it was
+// used up, and the timer path skips the yield.
+int charge_tick(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  int throttled = 0;
+
+  p->accumulator = p->accumulator + p->ps_priority; // Task5
+  p->vruntime += cfs_decay[p->cfs_priority];
+  p->pass += STRIDE1 / (p->tickets + p->donated);
+  if (curr_sched_policy == 2)
+    p->gdelta += (GROUP_WEIGHT << VRUNTIME_SHIFT) / groups[p->group].weight;
+  if (p->edf_runtime > 0)
+  {
+    acquire(&p->lock);
+    if (p->edf_budget > 0 && --p->edf_budget == 0)
+      throttled = 1;
+    release(&p->lock);
+  }
+  if (curr_sched_policy == 3)
   {
-  case 0:
-    decay_factor = 75;
-    break;
-  case 1:
-    decay_factor = 100;
-    break;
-  case 2:
-    decay_factor = 125;
-    break;
-  default:
-    break;
+    mlfq_refresh(p);
+    if (++p->mlfq_used >= MLFQ_SLICE(p->mlfq_level))
+    {
+      if (p->mlfq_level < MLFQ_LEVELS - 1)
+        p->mlfq_level++;
+      p->mlfq_used = 0;
+      p->slice_left = 1;
+    }
   }
-  vruntime = decay_factor * ((p->rtime) / (p->rtime + p->stime + p->retime));
-  return vruntime;
+
+  if (throttled)
+    return 1;
+  // racy reads of the queues; the worst case is a tick of delay.
+  if (curr_sched_policy == 3 && (c->rq.mlfq_mask & ((1 << p->mlfq_level) - 1)) != 0)
+    return 1;
+  if (--p->slice_left > 0)
+    return 0;
+  if (c->rq.nr > 0 || balance_due(c))
+    return 1;
+  p->slice_left = time_slice(p);
+  return 0;
 }
 
-// Added for Task6
-// gets the minimum value of the vruntime of
-// all the runnable/running processes
-long long
-get_min_vruntime()
+// Once per MLFQ_BOOST ticks, move every process on c's run
+// queue to level 0, keeping them in level order. Running and
+// sleeping processes are moved by mlfq_refresh() when they are
+// next charged or queued.
+static void
+mlfq_boost(struct cpu *c)
 {
-  long long min_vruntime = 0;
-  long long curr_vruntime;
+  uint epoch = ticks / MLFQ_BOOST;
   struct proc *p;
+  int l;
+
+  if (curr_sched_policy != 3 || c->mlfq_epoch == epoch)
+    return;
+  c->mlfq_epoch = epoch;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&c->rq.lock);
+  for (l = 1; l < MLFQ_LEVELS && curr_sched_policy == 3; l++)
   {
-    acquire(&p->lock);
-    if ((p->state == RUNNABLE))
+    while ((p = c->rq.mlfq_head[l]) != 0)
     {
-      curr_vruntime = get_vruntime(p);
-      if (min_vruntime == 0)
-        min_vruntime = curr_vruntime;
-      else if (curr_vruntime < min_vruntime)
-        min_vruntime = curr_vruntime;
+      rq_remove(&c->rq, p);
+      p->mlfq_level = 0;
+      p->mlfq_used = 0;
+      p->mlfq_epoch = epoch;
+      rq_insert(&c->rq, p);
     }
-    release(&p->lock);
   }
-  return min_vruntime;
+  release(&c->rq.lock);
 }
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void proc_mapstacks(pagetable_t kpgtbl)
+// Carve a new slab page into descriptors and put them on
+// ptable.free. Each gets a page for its kernel stack, mapped
+// high in memory, followed by an invalid guard page.
+// Returns -1 if out of memory. ptable.lock must be held.
+static int
+proc_grow(void)
 {
-  struct proc *p;
+  struct proc *slab, *p;
+  char *pa;
+  uint64 va;
+  int n = 0;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if ((slab = (struct proc *)kalloc()) == 0)
+    return -1;
+  for (p = slab; p + 1 <= (struct proc *)((char *)slab + PGSIZE); p++)
+  {
+    va = KSTACK(ptable.nslot);
+    if ((pa = kalloc()) == 0)
+      break;
+    if (mappages(kernel_pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W) < 0)
+    {
+      kfree(pa);
+      break;
+    }
+    ptable.nslot++;
+    memset(p, 0, sizeof(*p));
+    initlock(&p->lock, "proc");
+    initlock(&p->wait_lock, "wait_lock");
+    p->state = UNUSED;
+    p->kstack = va;
+    p->all_next = ptable.free;
+    ptable.free = p;
+    n++;
+  }
+  if (n == 0)
   {
-    char *pa = kalloc();
-    if (pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int)(p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+    kfree(slab);
+    return -1;
   }
+  sfence_vma();
+  __sync_fetch_and_add(&kstack_gen, 1);
+  return 0;
+}
+
+// Give a descriptor freed by freeproc() back to the slab
+// cache. Call without p->lock, after freeproc().
+static void
+proc_put(struct proc *p)
+{
+  acquire(&ptable.lock);
+  if (p->all_prev)
+    p->all_prev->all_next = p->all_next;
+  else
+    ptable.live = p->all_next;
+  if (p->all_next)
+    p->all_next->all_prev = p->all_prev;
+  p->all_next = ptable.free;
+  ptable.free = p;
+  ptable.nproc--;
+  release(&ptable.lock);
 }
 
 // initialize the proc table.
 void procinit(void)
 {
-  struct proc *p;
+  struct cpu *c;
+  int i;
 
+  initlock(&ptable.lock, "ptable");
+  maxproc = kfreepages() / PROC_PAGES;
+  if (maxproc > NHEAPDIR * HEAP_PER_PAGE)
+    maxproc = NHEAPDIR * HEAP_PER_PAGE;
   initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for (p = proc; p < &proc[NPROC]; p++)
+  initlock(&timerwheel.lock, "timerwheel");
+  initlock(&policy_lock, "policy");
+  initlock(&edf_lock, "edf");
+  initlock(&edf_rq.lock, "edfq");
+  edf_rq.id = -1;
+  initlock(&group_lock, "group");
+  groups[0].nproc = 1;
+  groups[0].weight = GROUP_WEIGHT;
+  for (c = cpus; c < &cpus[NCPU]; c++)
   {
-    initlock(&p->lock, "proc");
-    p->state = UNUSED;
-    p->kstack = KSTACK((int)(p - proc));
+    initlock(&c->rq.lock, "runq");
+    c->rq.id = c - cpus;
+    initlock(&c->hr_lock, "hrtimer");
   }
+  for (i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
 }
 
 // Must be called with interrupts disabled,
@@ -192,74 +1292,134 @@ myproc(void)
   return p;
 }
 
-int allocpid()
+// Give p the next pid and enter it in the pid hash.
+// p->lock must be held.
+int allocpid(struct proc *p)
 {
   int pid;
 
   acquire(&pid_lock);
   pid = nextpid;
   nextpid = nextpid + 1;
+  p->pid = pid;
+  p->pid_next = pidhash[PIDHASH(pid)];
+  pidhash[PIDHASH(pid)] = p;
   release(&pid_lock);
 
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Take p out of the pid hash. p->lock must be held.
+static void
+freepid(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for (pp = &pidhash[PIDHASH(p->pid)]; *pp; pp = &(*pp)->pid_next)
+  {
+    if (*pp == p)
+    {
+      *pp = p->pid_next;
+      break;
+    }
+  }
+  release(&pid_lock);
+  p->pid = 0;
+}
+
+// Find the live process with the given pid.
+// Returns it with p->lock held, or 0 if there is none.
 static struct proc *
-allocproc(void)
+pidlookup(int pid)
 {
   struct proc *p;
-  int firstProc = 1;
 
-  long long min_acc = get_min_acc();
+  acquire(&pid_lock);
+  for (p = pidhash[PIDHASH(pid)]; p && p->pid != pid; p = p->pid_next)
+    ;
+  release(&pid_lock);
+  if (p == 0)
+    return 0;
 
-  // checking if only process unblocked
-  for (p = proc; p < &proc[NPROC]; p++)
+  // p may have been freed, and even reused, meanwhile.
+  acquire(&p->lock);
+  if (p->pid != pid || p->state == UNUSED)
   {
-    acquire(&p->lock);
-    if (p->state == RUNNABLE || p->state == RUNNING)
-    {
-      firstProc = 0;
-    }
     release(&p->lock);
+    return 0;
   }
+  return p;
+}
+
+// Take a descriptor from the slab cache, growing it if need be,
+// and put it on the live list. Initialize state required to
+// run in the kernel, and return with p->lock held.
+// If maxproc processes exist, or a memory allocation fails, return 0.
+static struct proc *
+allocproc(void)
+{
+  struct proc *p;
+  int n;
+
+  long long min_acc = get_min_acc();
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&ptable.lock);
+  if (ptable.nproc >= maxproc || (ptable.free == 0 && proc_grow() < 0))
   {
-    acquire(&p->lock);
-    if (p->state == UNUSED)
-    {
-      goto found;
-    }
-    else
-    {
-      release(&p->lock);
-    }
+    release(&ptable.lock);
+    return 0;
+  }
+  p = ptable.free;
+  ptable.free = p->all_next;
+  p->all_prev = 0;
+  p->all_next = ptable.live;
+  if (ptable.live)
+    ptable.live->all_prev = p;
+  ptable.live = p;
+  n = ++ptable.nproc;
+  release(&ptable.lock);
+
+  if (heap_reserve(n) < 0)
+  {
+    proc_put(p);
+    return 0;
   }
-  return 0;
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
+  allocpid(p);
   p->state = USED;
   p->ps_priority = 5;
-  if (firstProc)
-    p->accumulator = 0;
-  else
-    p->accumulator = min_acc;
+  p->ps_base = 5;
+  p->accumulator = min_acc;
   // 4 lines for Task6
   p->retime = 0;
   p->rtime = 0;
   p->stime = 0;
   p->cfs_priority = 1;
+  p->cfs_base = 1;
+  p->blocked_on = 0;
+  p->held = 0;
+  p->cpumask = -1;
+  p->edf_runtime = 0;
+  p->edf_budget = 0;
+  p->edf_misses = 0;
+  p->group = -1; // joins one in fork() or userinit()
+  p->gdelta = 0;
+  p->tickets = STRIDE_TICKETS;
+  p->donated = 0;
+  p->pass = 0;
+  p->lent_to = 0;
+  p->mlfq_level = 0;
+  p->mlfq_used = 0;
+  p->mlfq_epoch = ticks / MLFQ_BOOST;
 
   // Allocate a trapframe page.
   if ((p->trapframe = (struct trapframe *)kalloc()) == 0)
   {
     freeproc(p);
     release(&p->lock);
+    proc_put(p);
     return 0;
   }
 
@@ -269,6 +1429,7 @@ found:
   {
     freeproc(p);
     release(&p->lock);
+    proc_put(p);
     return 0;
   }
 
@@ -283,7 +1444,8 @@ found:
 
 // free a proc structure and the data hanging from it,
 // including user pages.
-// p->lock must be held.
+// p->lock must be held; once it is released, the caller
+// gives the descriptor back with proc_put().
 static void
 freeproc(struct proc *p)
 {
@@ -294,7 +1456,13 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
+  if (p->pid)
+    freepid(p);
+  // only now can p no longer be queued, so its group's state
+  // on each hart is safe to reuse.
+  if (p->group >= 0)
+    group_put(p->group);
+  p->group = -1;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
@@ -367,6 +1535,7 @@ void userinit(void)
 
   p = allocproc();
   initproc = p;
+  p->group = 0; // procinit() counted init in groups[0]
 
   // allocate one user page and copy initcode's instructions
   // and data into it.
@@ -380,7 +1549,7 @@ void userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
@@ -427,6 +1596,7 @@ int fork(void)
   {
     freeproc(np);
     release(&np->lock);
+    proc_put(np);
     return -1;
   }
   np->sz = p->sz;
@@ -449,32 +1619,76 @@ int fork(void)
 
   release(&np->lock);
 
-  acquire(&wait_lock);
+  acquire(&p->wait_lock);
   np->parent = p;
-  release(&wait_lock);
+  child_link(&p->children, np);
+  release(&p->wait_lock);
+
+  acquire(&group_lock);
+  groups[p->group].nproc++;
+  release(&group_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
-  np->cfs_priority = p->cfs_priority; // Task6
+  np->cfs_priority = p->cfs_base; // Task6
+  np->cfs_base = p->cfs_base;
+  np->tickets = p->tickets;
+  np->cpumask = p->cpumask;
+  np->group = p->group;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
-// Pass p's abandoned children to init.
-// Caller must hold wait_lock.
+// Push p onto the child list at *head.
+static void
+child_link(struct proc **head, struct proc *p)
+{
+  p->sib_prev = 0;
+  p->sib_next = *head;
+  if (*head)
+    (*head)->sib_prev = p;
+  *head = p;
+}
+
+// Take p off the child list at *head.
+static void
+child_unlink(struct proc **head, struct proc *p)
+{
+  if (p->sib_prev)
+    p->sib_prev->sib_next = p->sib_next;
+  else
+    *head = p->sib_next;
+  if (p->sib_next)
+    p->sib_next->sib_prev = p->sib_prev;
+}
+
+// Pass p's abandoned children, live and zombie, to init.
+// Costs O(children), not a scan of proc[].
+// Caller must hold p->wait_lock.
 void reparent(struct proc *p)
 {
   struct proc *pp;
+  int zombies = p->zombies != 0;
 
-  for (pp = proc; pp < &proc[NPROC]; pp++)
+  if (p->children == 0 && p->zombies == 0)
+    return;
+  acquire(&initproc->wait_lock);
+  while ((pp = p->children) != 0)
   {
-    if (pp->parent == p)
-    {
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+    child_unlink(&p->children, pp);
+    pp->parent = initproc;
+    child_link(&initproc->children, pp);
+  }
+  while ((pp = p->zombies) != 0)
+  {
+    child_unlink(&p->zombies, pp);
+    pp->parent = initproc;
+    child_link(&initproc->zombies, pp);
   }
+  if (zombies)
+    wakeup(initproc);
+  release(&initproc->wait_lock);
 }
 
 // Exit the current process.  Does not return.
@@ -483,6 +1697,7 @@ void reparent(struct proc *p)
 void exit(int status, char *msg)
 {
   struct proc *p = myproc();
+  struct proc *pp;
 
   if (p == initproc)
     panic("init exiting");
@@ -503,24 +1718,43 @@ void exit(int status, char *msg)
   end_op();
   p->cwd = 0;
 
-  acquire(&wait_lock);
+  // give back any EDF bandwidth.
+  if (p->edf_runtime > 0)
+    set_edf(0, 0, 0);
 
   // Give any children to init.
+  acquire(&p->wait_lock);
   reparent(p);
+  release(&p->wait_lock);
+
+  // Lock our parent's wait_lock; if the parent exits
+  // meanwhile, we have been passed to init, so try again.
+  for (;;)
+  {
+    pp = p->parent;
+    acquire(&pp->wait_lock);
+    if (p->parent == pp)
+      break;
+    release(&pp->wait_lock);
+  }
 
   // Parent might be sleeping in wait().
-  wakeup(p->parent);
+  wakeup(pp);
 
   acquire(&p->lock);
 
   p->xstate = status;
+  trace(TRACE_EXIT, p, status);
+  update_timers(p);
   p->state = ZOMBIE;
   // argstr(1, p->exit_msg, 32); //TODO
   safestrcpy(p->exit_msg, msg, sizeof(p->exit_msg));
 
   //*(p->exit_msg) = msg; // NEW
 
-  release(&wait_lock);
+  child_unlink(&pp->children, p);
+  child_link(&pp->zombies, p);
+  release(&pp->wait_lock);
 
   // Jump into the scheduler, never to return.
   sched();
@@ -529,194 +1763,148 @@ void exit(int status, char *msg)
 
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Only looks at this process's own zombies.
 int wait(uint64 addr, uint64 ptr)
 {
   struct proc *pp;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
-  acquire(&wait_lock);
+  acquire(&p->wait_lock);
 
   for (;;)
   {
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for (pp = proc; pp < &proc[NPROC]; pp++)
+    if ((pp = p->zombies) != 0)
     {
-      if (pp->parent == p)
-      {
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
 
-        // if(copyout(p->pagetable, ptr, (char*)pp->exit_msg, 32) < 0){
-        //   return -1;
-        // }
-
-        havekids = 1;
-        if (pp->state == ZOMBIE)
-        {
-          // Found one.
-          pid = pp->pid;
-          if (addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                   sizeof(pp->xstate)) < 0)
-          {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          if (ptr != 0 && copyout(p->pagetable, ptr, pp->exit_msg, 32) < 0)
-          {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
+      pid = pp->pid;
+      if (addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                               sizeof(pp->xstate)) < 0)
+      {
+        release(&pp->lock);
+        release(&p->wait_lock);
+        return -1;
+      }
+      if (ptr != 0 && copyout(p->pagetable, ptr, pp->exit_msg, 32) < 0)
+      {
         release(&pp->lock);
+        release(&p->wait_lock);
+        return -1;
       }
+      child_unlink(&p->zombies, pp);
+      freeproc(pp);
+      release(&pp->lock);
+      release(&p->wait_lock);
+      proc_put(pp);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if (!havekids || killed(p))
+    if (p->children == 0 || killed(p))
     {
-      release(&wait_lock);
+      release(&p->wait_lock);
       return -1;
     }
 
     // Wait for a child to exit.
-    sleep(p, &wait_lock); // DOC: wait-sleep
-  }
-}
-
-// Per-CPU process scheduler.
-// Each CPU calls scheduler() after setting itself up.
-// Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
-//  - swtch to start running that process.
-//  - eventually that process transfers control
-//    via swtch back to the scheduler.
-void scheduler(void)
-{
-  for (;;)
-  {
-    switch (curr_sched_policy)
-    {
-    case 0:
-      default_scheduler();
-      break;
-    case 1:
-      ps_scheduler();
-      break;
-    case 2:
-      cfs_scheduler();
-      break;
-    default:
-      break;
-    }
+    sleep(p, &p->wait_lock); // DOC: wait-sleep
   }
 }
 
-void cfs_scheduler(void) // Task 6
+// Nothing to run on this hart: wait in wfi until an interrupt
+// (a clock tick, a device, or an IPI from cpukick()) arrives.
+// c->idle is published before a last look at the queues, with
+// interrupts off, so a process queued after that look kicks us
+// and the pending IPI ends the wfi at once.
+// Returns a process found by that last look, or 0.
+static struct proc *
+cpu_idle(struct cpu *c)
 {
   struct proc *p;
-  struct cpu *c = mycpu();
-
-  c->proc = 0;
-  for (; curr_sched_policy == 2;)
-  {
-    // Avoid deadlock by ensuring that devices can interrupt.
-    intr_on();
+  uint64 start;
 
-    long long min_vruntime = get_min_vruntime(); // Task6
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
 
-    // finiding the process with min value vruntime
-    for (p = proc; p < &proc[NPROC]; p++)
-    {
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        if (get_vruntime(p) == min_vruntime)
-        {
-          p->state = RUNNING;
-          c->proc = p;
-          swtch(&c->context, &p->context);
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
-        }
-      }
-      release(&p->lock);
-    }
+  p = rq_pick(c);
+  if (p == 0)
+    p = rq_steal(c);
+  if (p == 0)
+  {
+    // interrupts are off, so none is handled in here.
+    start = r_time();
+    asm volatile("wfi");
+    c->idle_cycles += r_time() - start;
   }
+
+  c->idle = 0;
+  return p;
 }
 
-void ps_scheduler(void) // Task 5
+// Per-CPU process scheduler.
+// Each CPU calls scheduler() after setting itself up.
+// Scheduler never returns.  It loops, doing:
+//  - choose a process to run: the EDF process with the
+//    earliest deadline, else the one the current policy
+//    puts first in this CPU's run queue, or, if the queue is
+//    empty, one stolen from the busiest other CPU.
+//  - swtch to start running that process.
+//  - eventually that process transfers control
+//    via swtch back to the scheduler.
+void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  uint64 start, irq;
 
   c->proc = 0;
-  for (; curr_sched_policy == 1;)
+  __sync_fetch_and_or(&online_cpus, 1L << (c - cpus));
+  for (;;)
   {
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    long long min_acc = get_min_acc();
-
-    // finiding the process with min value accumulator
-    for (p = proc; p < &proc[NPROC]; p++)
-    {
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        if (p->accumulator == min_acc)
-        {
-          p->state = RUNNING;
-          c->proc = p;
-          swtch(&c->context, &p->context);
-
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
-        }
-      }
-      release(&p->lock);
-    }
-  }
-}
-
-void default_scheduler(void)
-{
-  struct proc *p;
-  struct cpu *c = mycpu();
+    rq_balance(c);
+    mlfq_boost(c);
 
-  c->proc = 0;
-  for (; curr_sched_policy == 0;)
-  {
-    // Avoid deadlock by ensuring that devices can interrupt.
-    intr_on();
+    p = rq_pick(c);
+    if (p == 0 && (p = rq_steal(c)) == 0 && (p = cpu_idle(c)) == 0)
+      continue;
 
-    for (p = proc; p < &proc[NPROC]; p++)
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    acquire(&p->lock);
+    if (p->state != RUNNABLE)
+      panic("scheduler: queued process not runnable");
+    update_timers(p);
+    p->state = RUNNING;
+    p->cpu = c - cpus;
+    p->slice_left = time_slice(p);
+    c->proc = p;
+    c->need_resched = 0;
+    trace(TRACE_SWITCHIN, p, 0);
+    // p's kernel stack may be newer than this hart's TLB.
+    if (c->kstack_gen != kstack_gen)
     {
-      acquire(&p->lock);
-      if (p->state == RUNNABLE)
-      {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+      c->kstack_gen = kstack_gen;
+      sfence_vma();
     }
+    start = r_time();
+    irq = c->irq_cycles;
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // p ran on this hart throughout, less the interrupts it took.
+    c->busy_cycles += r_time() - start - (c->irq_cycles - irq);
+    trace(TRACE_SWITCHOUT, p, p->state == RUNNABLE);
+    group_charge(c, p);
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -751,7 +1939,7 @@ void yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -765,66 +1953,265 @@ void forkret(void)
   // Still holding p->lock from scheduler.
   release(&myproc()->lock);
 
-  if (first)
+  if (first)
+  {
+    // File system initialization must be run in the context of a
+    // regular process (e.g., because it calls sleep), and thus cannot
+    // be run from main().
+    first = 0;
+    fsinit(ROOTDEV);
+  }
+
+  usertrapret();
+}
+
+// Sleep queue for chan: the top bits of a Fibonacci hash.
+static struct sleepq *
+sleepq_of(void *chan)
+{
+  return &sleepq[((uint64)chan * 0x9E3779B97F4A7C15L) >> (64 - SLEEPQ_SHIFT)];
+}
+
+// Take p off sq. sq->lock must be held.
+static void
+sleepq_remove(struct sleepq *sq, struct proc *p)
+{
+  if (p->sq_prev)
+    p->sq_prev->sq_next = p->sq_next;
+  else
+    sq->head = p->sq_next;
+  if (p->sq_next)
+    p->sq_next->sq_prev = p->sq_prev;
+  p->sq = 0;
+}
+
+// Atomically release lock and sleep on chan.
+// Reacquires lock when awakened.
+void sleep(void *chan, struct spinlock *lk)
+{
+  struct proc *p = myproc();
+  struct sleepq *sq = sleepq_of(chan);
+
+  // Join chan's sleep queue before releasing lk, so a
+  // wakeup() after that finds us; it then waits for p->lock,
+  // which we hold until sched() has switched away.
+
+  acquire(&sq->lock);
+  p->sq_prev = 0;
+  p->sq_next = sq->head;
+  if (sq->head)
+    sq->head->sq_prev = p;
+  sq->head = p;
+  p->sq = sq;
+
+  acquire(&p->lock); // DOC: sleeplock1
+  p->chan = chan;
+  release(&sq->lock);
+  release(lk);
+
+  // Go to sleep.
+  update_timers(p);
+  p->state = SLEEPING;
+  // keep only the lead or lag on this hart; setrunnable()
+  // adds back the min_vruntime of the hart that wakes us.
+  p->vruntime -= mycpu()->rq.min_vruntime;
+
+  sched();
+
+  // Tidy up.
+  p->chan = 0;
+  release(&p->lock);
+
+  // kill() wakes us without taking us off the queue.
+  acquire(&sq->lock);
+  if (p->sq == sq)
+    sleepq_remove(sq, p);
+  release(&sq->lock);
+
+  // Reacquire original lock.
+  acquire(lk);
+}
+
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void wakeup(void *chan)
+{
+  struct sleepq *sq = sleepq_of(chan);
+  struct proc *p, *next;
+
+  acquire(&sq->lock);
+  for (p = sq->head; p; p = next)
+  {
+    next = p->sq_next;
+    // chan is set before p joins the queue; a stale read
+    // only means we lock and check again.
+    if (p->chan != chan)
+      continue;
+    acquire(&p->lock);
+    if (p->chan == chan)
+    {
+      if (p->state == SLEEPING)
+        setrunnable(p);
+      sleepq_remove(sq, p);
+    }
+    release(&p->lock);
+  }
+  release(&sq->lock);
+}
+
+// Take p off its timer wheel slot. timerwheel.lock must be held.
+static void
+timer_remove(struct proc *p)
+{
+  if (p->tw_prev)
+    p->tw_prev->tw_next = p->tw_next;
+  else
+    timerwheel.slot[p->wake_tick % NTWSLOT] = p->tw_next;
+  if (p->tw_next)
+    p->tw_next->tw_prev = p->tw_prev;
+  p->tw_queued = 0;
+}
+
+// Sleep until the clock reaches tick when.
+// Returns -1 if killed first, else 0.
+int sleep_until(uint when)
+{
+  struct proc *p = myproc();
+  struct proc **slot = &timerwheel.slot[when % NTWSLOT];
+
+  acquire(&timerwheel.lock);
+  while ((int)(when - ticks) > 0)
   {
-    // File system initialization must be run in the context of a
-    // regular process (e.g., because it calls sleep), and thus cannot
-    // be run from main().
-    first = 0;
-    fsinit(ROOTDEV);
+    if (killed(p))
+    {
+      release(&timerwheel.lock);
+      return -1;
+    }
+    p->wake_tick = when;
+    p->tw_prev = 0;
+    p->tw_next = *slot;
+    if (*slot)
+      (*slot)->tw_prev = p;
+    *slot = p;
+    p->tw_queued = 1;
+    sleep(&p->wake_tick, &timerwheel.lock);
+    // kill() wakes us while we are still on the wheel.
+    if (p->tw_queued)
+      timer_remove(p);
   }
+  release(&timerwheel.lock);
+  return 0;
+}
 
-  usertrapret();
+// Sleep for n clock ticks.
+int sleep_ticks(int n)
+{
+  return sleep_until(ticks + n);
 }
 
-// Atomically release lock and sleep on chan.
-// Reacquires lock when awakened.
-void sleep(void *chan, struct spinlock *lk)
+// usleep() waits finer than a tick on a per-hart list of
+// deadlines in r_time() cycles. The earliest is handed to
+// timervec in timer_scratch[id][8], which programs mtimecmp for
+// it as well as for the next tick and sets timer_scratch[id][9]
+// when it passes; devintr() then calls hrtimer_intr().
+// Lock order: hr_lock, then the sleepq locks.
+extern uint64 timer_scratch[NCPU][TIMER_SCRATCH];
+
+// Give hart id's earliest deadline to timervec, which picks it
+// up on the IPI. c->hr_lock must be held.
+static void
+hrtimer_arm(struct cpu *c)
 {
-  struct proc *p = myproc();
+  int id = c - cpus;
 
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  timer_scratch[id][8] = c->hrtimers ? c->hrtimers->hr_deadline : -1;
+  __sync_synchronize();
+  cpukick(id);
+}
 
-  acquire(&p->lock); // DOC: sleeplock1
-  release(lk);
+// A one-shot deadline on this hart has passed: wake the
+// usleep() callers that are due and arm the next deadline.
+void hrtimer_intr(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  struct proc *p;
 
-  // Go to sleep.
-  p->chan = chan;
-  p->state = SLEEPING;
+  acquire(&c->hr_lock);
+  while ((p = c->hrtimers) != 0 && p->hr_deadline <= now)
+  {
+    c->hrtimers = p->hr_next;
+    p->hr_next = 0;
+    wakeup(&p->hr_deadline);
+  }
+  hrtimer_arm(c);
+  release(&c->hr_lock);
+}
 
-  sched();
+// Sleep for at least us microseconds, by r_time(), on this
+// hart's hrtimers. Returns -1 if killed first, else 0.
+int usleep(uint64 us)
+{
+  struct proc *p = myproc(), **pp;
+  uint64 end = r_time() + us * (TRACE_TIMEBASE / 1000000);
+  struct cpu *c;
+  int r = 0;
 
-  // Tidy up.
-  p->chan = 0;
+  if (us == 0)
+    return 0;
+  push_off();
+  c = mycpu();
+  pop_off();
 
-  // Reacquire original lock.
-  release(&p->lock);
-  acquire(lk);
+  // c stays the hart whose interrupt wakes us, wherever we run.
+  acquire(&c->hr_lock);
+  p->hr_deadline = end;
+  for (pp = &c->hrtimers; *pp && (*pp)->hr_deadline <= end; pp = &(*pp)->hr_next)
+    ;
+  p->hr_next = *pp;
+  *pp = p;
+  if (c->hrtimers == p)
+    hrtimer_arm(c);
+  while (r_time() < end)
+  {
+    if (killed(p))
+    {
+      r = -1;
+      break;
+    }
+    sleep(&p->hr_deadline, &c->hr_lock);
+  }
+  // killed, or woken by kill(): we may still be on the list.
+  for (pp = &c->hrtimers; *pp; pp = &(*pp)->hr_next)
+  {
+    if (*pp == p)
+    {
+      *pp = p->hr_next;
+      break;
+    }
+  }
+  p->hr_next = 0;
+  release(&c->hr_lock);
+  return r;
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
-void wakeup(void *chan)
+// Called on every clock tick, after ticks has advanced:
+// wake the processes whose time has come.
+void timer_tick(void)
 {
-  struct proc *p;
+  struct proc *p, *next;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  acquire(&timerwheel.lock);
+  for (p = timerwheel.slot[ticks % NTWSLOT]; p; p = next)
   {
-    if (p != myproc())
+    next = p->tw_next;
+    if ((int)(p->wake_tick - ticks) <= 0)
     {
-      acquire(&p->lock);
-      if (p->state == SLEEPING && p->chan == chan)
-      {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+      timer_remove(p);
+      wakeup(&p->wake_tick);
     }
   }
+  release(&timerwheel.lock);
 }
 
 // Kill the process with the given pid.
@@ -834,23 +2221,16 @@ int kill(int pid)
 {
   struct proc *p;
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if ((p = pidlookup(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if (p->state == SLEEPING)
   {
-    acquire(&p->lock);
-    if (p->pid == pid)
-    {
-      p->killed = 1;
-      if (p->state == SLEEPING)
-      {
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void setkilled(struct proc *p)
@@ -905,6 +2285,8 @@ int either_copyin(void *dst, int user_src, uint64 src, uint64 len)
 }
 
 // Print a process listing to console.  For debugging.
+// Walks the live list without ptable.lock; descriptors are
+// never freed, so at worst it sees a stale entry.
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
 void procdump(void)
@@ -920,7 +2302,7 @@ void procdump(void)
   char *state;
 
   printf("\n");
-  for (p = proc; p < &proc[NPROC]; p++)
+  for (p = ptable.live; p; p = p->all_next)
   {
     if (p->state == UNUSED)
       continue;
@@ -935,14 +2317,16 @@ void procdump(void)
 
 void set_ps_priority(int new_priority)
 {
-  myproc()->ps_priority = new_priority;
+  myproc()->ps_base = new_priority;
+  pi_restore();
 }
 
 int set_cfs_priority(int new_priority)
 {
   if (new_priority == 0 || new_priority == 1 || new_priority == 2)
   {
-    myproc()->cfs_priority = new_priority;
+    myproc()->cfs_base = new_priority;
+    pi_restore();
     return 0;
   }
   return -1;
@@ -953,40 +2337,541 @@ int get_cfs_priority(int pid, uint64 ptr)
   struct proc *p;
   int details[4];
 
-  for (p = proc; p < &proc[NPROC]; p++)
+  if ((p = pidlookup(pid)) == 0)
+    return -1;
+  update_timers(p);
+  details[0] = p->cfs_priority;
+  details[1] = p->rtime;
+  details[2] = p->stime;
+  details[3] = p->retime;
+  release(&p->lock);
+  if (copyout(myproc()->pagetable, ptr, (char *)details, sizeof(details)) < 0)
+    return -1;
+  return 0;
+}
+
+// Switch the scheduling policy. Every run queue is rebuilt
+// under the new policy while all of them are locked, so no
+// hart ever dispatches from a queue built for another policy.
+int set_policy(int new_policy)
+{
+  struct proc *queued[NCPU];
+  struct proc *p;
+  int i;
+
+  if (new_policy >= 0 && new_policy < NPOLICY)
   {
-    acquire(&p->lock);
-    if (p->pid == pid)
+    acquire(&policy_lock);
+    for (i = 0; i < NCPU; i++)
+      acquire(&cpus[i].rq.lock);
+
+    for (i = 0; i < NCPU; i++)
     {
-      details[0] = p->cfs_priority;
-      details[1] = p->rtime;
-      details[2] = p->stime;
-      details[3] = p->retime;
-      if (copyout(p->pagetable, ptr, (char *)details, sizeof(details)) < 0)
+      queued[i] = 0;
+      while ((p = rq_pop(&cpus[i].rq, -1)) != 0)
       {
-        release(&p->lock);
-        return -1;
+        p->rq_next = queued[i];
+        queued[i] = p;
       }
-      else
+    }
+    curr_sched_policy = new_policy;
+    for (i = 0; i < NCPU; i++)
+    {
+      // restart min_vruntime from what is actually queued;
+      // it is not maintained while another policy runs.
+      for (p = queued[i]; p; p = p->rq_next)
+        if (p == queued[i] || p->vruntime < cpus[i].rq.min_vruntime)
+          cpus[i].rq.min_vruntime = p->vruntime;
+      // and min_pass likewise.
+      for (p = queued[i]; p; p = p->rq_next)
+        if (p == queued[i] || p->pass < cpus[i].rq.min_pass)
+          cpus[i].rq.min_pass = p->pass;
+      while ((p = queued[i]) != 0)
       {
-        release(&p->lock);
-        return 0;
+        queued[i] = p->rq_next;
+        rq_insert(&cpus[i].rq, p);
       }
     }
-    release(&p->lock);
+
+    for (i = NCPU - 1; i >= 0; i--)
+      release(&cpus[i].rq.lock);
+    release(&policy_lock);
+
+    return 0;
   }
   return -1;
 }
 
-int set_policy(int new_policy)
+// Restrict the process with the given pid (0 for the caller) to
+// the harts in mask. A queued process on a hart it may no longer
+// use is moved to an allowed one; a running one moves when it
+// next gives up its hart, which for the caller is right away.
+int set_affinity(int pid, uint64 mask)
+{
+  struct proc *p;
+  struct runq *rq;
+  int id, move;
+
+  if ((mask & online_cpus) == 0)
+    return -1;
+  if ((p = pidlookup(pid ? pid : myproc()->pid)) == 0)
+    return -1;
+
+  p->cpumask = mask;
+  // any hart may take p from edf_rq, so it need not move.
+  if (p->state == RUNNABLE && (rq = p->rq) != 0 && rq != &edf_rq)
+  {
+    id = rq->id;
+    acquire(&rq->lock);
+    // a hart may have taken p off the queue to run it meanwhile.
+    if (p->rq == rq && !cpu_allowed(p, id))
+    {
+      rq_remove(rq, p);
+      p->vruntime -= rq->min_vruntime;
+      release(&rq->lock);
+      rq = rq_select(p);
+      acquire(&rq->lock);
+      p->vruntime += rq->min_vruntime;
+      rq_insert(rq, p);
+    }
+    release(&rq->lock);
+  }
+  move = p == myproc() && !cpu_allowed(p, cpuid());
+  release(&p->lock);
+
+  if (move)
+    yield();
+  return 0;
+}
+
+// Store the affinity mask of the process with the given pid
+// (0 for the caller) in *mask.
+int get_affinity(int pid, uint64 *mask)
+{
+  struct proc *p;
+
+  if ((p = pidlookup(pid ? pid : myproc()->pid)) == 0)
+    return -1;
+  *mask = p->cpumask & online_cpus;
+  release(&p->lock);
+  return 0;
+}
+
+// get_procs() gathers its records in a list of pages.
+#define PSTAT_PER_PAGE ((PGSIZE - sizeof(void *)) / sizeof(struct pstat))
+
+struct pstatpage
+{
+  struct pstatpage *next;
+  struct pstat ps[PSTAT_PER_PAGE];
+};
+
+static void
+pstat_free(struct pstatpage *pg)
 {
-  if (new_policy == 0 || new_policy == 1 || new_policy == 2)
+  struct pstatpage *next;
+
+  for (; pg; pg = next)
   {
-    acquire(&policy_lock);
-    curr_sched_policy = new_policy;
-    release(&policy_lock);
+    next = pg->next;
+    kfree((void *)pg);
+  }
+}
+
+// Copy a struct pstat for each live process, at most n of them,
+// to the user array at addr. copyout() may fault and sleep, so
+// enough pages for every live process are allocated first, the
+// records are filled in by a single pass over the live list under
+// ptable.lock, and only then copied out.
+// Returns the number of records copied, or -1.
+int get_procs(uint64 addr, int n)
+{
+  struct proc *p;
+  struct pstatpage *pages, *pg;
+  struct pstat *ps;
+  int want, cap, count, i, len;
 
+  if (n <= 0)
     return 0;
+  for (;;)
+  {
+    // ptable.nproc is read without the lock here; if it has
+    // grown past what we allocated by the time we hold the
+    // lock, try again with more.
+    want = ptable.nproc < n ? ptable.nproc : n;
+    pages = 0;
+    for (cap = 0; cap < want; cap += PSTAT_PER_PAGE)
+    {
+      if ((pg = (struct pstatpage *)kalloc()) == 0)
+      {
+        pstat_free(pages);
+        return -1;
+      }
+      pg->next = pages;
+      pages = pg;
+    }
+    acquire(&ptable.lock);
+    if (cap >= n || cap >= ptable.nproc)
+      break;
+    release(&ptable.lock);
+    pstat_free(pages);
   }
-  return -1;
-}
\ No newline at end of file
+
+  count = 0;
+  pg = pages;
+  i = 0;
+  for (p = ptable.live; p && count < n; p = p->all_next)
+  {
+    acquire(&p->lock);
+    if (p->state != UNUSED)
+    {
+      if (i == PSTAT_PER_PAGE)
+      {
+        pg = pg->next;
+        i = 0;
+      }
+      update_timers(p);
+      ps = &pg->ps[i++];
+      ps->pid = p->pid;
+      ps->state = p->state;
+      ps->ps_priority = p->ps_priority;
+      ps->cfs_priority = p->cfs_priority;
+      ps->accumulator = p->accumulator;
+      ps->tickets = p->tickets;
+      ps->rtime = p->rtime;
+      ps->stime = p->stime;
+      ps->retime = p->retime;
+      ps->sz = p->sz;
+      ps->edf_runtime = p->edf_runtime;
+      ps->edf_period = p->edf_period;
+      ps->edf_misses = p->edf_misses;
+      safestrcpy(ps->name, p->name, sizeof(ps->name));
+      count++;
+    }
+    release(&p->lock);
+  }
+  release(&ptable.lock);
+
+  for (pg = pages, i = 0; i < count; pg = pg->next, i += PSTAT_PER_PAGE)
+  {
+    len = count - i < PSTAT_PER_PAGE ? count - i : PSTAT_PER_PAGE;
+    if (copyout(myproc()->pagetable, addr + i * sizeof(struct pstat),
+                (char *)pg->ps, len * sizeof(struct pstat)) < 0)
+    {
+      pstat_free(pages);
+      return -1;
+    }
+  }
+  pstat_free(pages);
+  return count;
+}
+
+// Make the caller an EDF process that needs runtime ticks of
+// CPU in every period ticks, each job done by deadline ticks
+// after its period starts (deadline 0 means the period).
+// runtime 0 leaves the EDF class. Admission fails, returning
+// -1, if the summed runtime/deadline of all EDF processes
+// would exceed one hart.
+int set_edf(int runtime, int period, int deadline)
+{
+  struct proc *p = myproc();
+  struct proc **pp;
+  uint64 bw = 0;
+
+  if (deadline == 0)
+    deadline = period;
+  if (runtime < 0 || (runtime > 0 && (runtime > deadline || deadline > period)))
+    return -1;
+  if (runtime > 0)
+    bw = (((uint64)runtime << EDF_SHIFT) + deadline - 1) / deadline;
+
+  acquire(&edf_lock);
+  if (edf_bw - p->edf_bw + bw > (1 << EDF_SHIFT))
+  {
+    release(&edf_lock);
+    return -1;
+  }
+  if (p->edf_bw == 0 && bw != 0)
+  {
+    p->edf_next = edf_list;
+    edf_list = p;
+  }
+  else if (p->edf_bw != 0 && bw == 0)
+  {
+    for (pp = &edf_list; *pp != p; pp = &(*pp)->edf_next)
+      ;
+    *pp = p->edf_next;
+  }
+  edf_bw += bw - p->edf_bw;
+  p->edf_bw = bw;
+
+  acquire(&p->lock);
+  p->edf_runtime = runtime;
+  p->edf_period = period;
+  p->edf_deadline = deadline;
+  p->edf_budget = runtime;
+  p->edf_dl = ticks + deadline;
+  p->edf_release = ticks + period;
+  release(&p->lock);
+  release(&edf_lock);
+
+  // start the first job from edf_rq right away.
+  if (runtime > 0)
+    yield();
+  return 0;
+}
+
+// Leave group g; it is free once its last member has left
+// or been freed by freeproc().
+static void
+group_put(int g)
+{
+  acquire(&group_lock);
+  // create_group() never hands out groups[0], so it is fine for
+  // it to empty when init leaves it.
+  groups[g].nproc--;
+  release(&group_lock);
+}
+
+// Create a cfs group with the given weight (GROUP_WEIGHT is
+// that of a new group) and move the caller into it; its
+// children will join it. The weight may be no more than that
+// of the group the caller leaves, so a process cannot give
+// itself a bigger share by starting a group of its own.
+// Returns the group id, or -1.
+int create_group(int weight)
+{
+  struct proc *p = myproc();
+  int g, old, i;
+
+  if (weight <= 0)
+    return -1;
+  acquire(&group_lock);
+  if (weight > groups[p->group].weight)
+  {
+    release(&group_lock);
+    return -1;
+  }
+  for (g = 1; g < NGROUP && groups[g].nproc > 0; g++)
+    ;
+  if (g == NGROUP)
+  {
+    release(&group_lock);
+    return -1;
+  }
+  groups[g].nproc = 1;
+  groups[g].weight = weight;
+  release(&group_lock);
+
+  // no member is queued anywhere, so no hart's tree holds it;
+  // the queue locks order this after the last dequeue.
+  for (i = 0; i < NCPU; i++)
+  {
+    acquire(&cpus[i].rq.lock);
+    groups[g].se[i].vruntime = 0;
+    groups[g].se[i].nr = 0;
+    release(&cpus[i].rq.lock);
+  }
+
+  acquire(&p->lock);
+  old = p->group;
+  p->group = g;
+  // time run so far belongs to the old group; drop it.
+  p->gdelta = 0;
+  release(&p->lock);
+  group_put(old);
+  return g;
+}
+
+// Set the weight of cfs group g, which must be the caller's,
+// to at most GROUP_WEIGHT. Returns 0, or -1.
+int set_group_weight(int g, int weight)
+{
+  int r = -1;
+
+  if (g < 0 || g >= NGROUP || weight <= 0 || weight > GROUP_WEIGHT)
+    return -1;
+  acquire(&group_lock);
+  // the caller is a member, so g cannot be freed meanwhile.
+  if (myproc()->group == g)
+  {
+    groups[g].weight = weight;
+    r = 0;
+  }
+  release(&group_lock);
+  return r;
+}
+
+// Number of RUNNABLE and RUNNING processes, for the load
+// average. Read without locks, so it is only a snapshot.
+int nr_running(void)
+{
+  struct cpu *c;
+  int n = edf_rq.nr;
+
+  for (c = cpus; c < &cpus[NCPU]; c++)
+    n += c->rq.nr + (c->proc != 0);
+  return n;
+}
+
+// Fill in the process and per-hart fields of st, for the
+// stats device. Like nr_running(), a snapshot taken without
+// the run queue locks.
+void procstats(struct sysstat *st)
+{
+  struct cpustat *cs;
+  struct cpu *c;
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  st->nproc = ptable.nproc;
+  release(&ptable.lock);
+  st->nrunning = nr_running();
+  st->ncpu = NCPU;
+  for (c = cpus; c < &cpus[NCPU]; c++)
+  {
+    cs = &st->cpu[c - cpus];
+    cs->busy = c->busy_cycles;
+    cs->idle = c->idle_cycles;
+    cs->irq = c->irq_cycles;
+    cs->online = (online_cpus >> (c - cpus)) & 1;
+    cs->nr = c->rq.nr;
+    // descriptors are never freed, so p is a struct proc even
+    // if it has exited since.
+    p = c->proc;
+    cs->pid = p ? p->pid : 0;
+  }
+}
+
+// Set the caller's stride tickets. Returns 0, or -1 if n is
+// out of range.
+int set_tickets(int n)
+{
+  if (n < 1 || n > STRIDE_MAX_TICKETS)
+    return -1;
+  myproc()->tickets = n;
+  return 0;
+}
+
+// The caller is about to sleep until the process with the
+// given pid does something for it: lend that process its
+// tickets, its own and those lent to it, until return_tickets().
+// Does nothing if pid is 0 or the caller's, or if the caller
+// is already lending.
+void lend_tickets(int pid)
+{
+  struct proc *p = myproc(), *q;
+  int lent;
+
+  if (pid == 0 || pid == p->pid || p->lent_to != 0)
+    return;
+  // others lend to p under p->lock; one proc lock at a time.
+  acquire(&p->lock);
+  lent = p->tickets + p->donated;
+  release(&p->lock);
+  // pidlookup() returns q with q->lock held.
+  if ((q = pidlookup(pid)) == 0)
+    return;
+  q->donated += lent;
+  release(&q->lock);
+  p->lent = lent;
+  p->lent_to = pid;
+}
+
+// Take back the tickets lent by lend_tickets(), if the
+// borrower still exists.
+void return_tickets(void)
+{
+  struct proc *p = myproc(), *q;
+
+  if (p->lent_to == 0)
+    return;
+  // pidlookup() returns q with q->lock held.
+  if ((q = pidlookup(p->lent_to)) != 0)
+  {
+    q->donated -= p->lent;
+    release(&q->lock);
+  }
+  p->lent_to = 0;
+}
+
+// Priority inheritance for sleeplocks. A process about to wait
+// for lk records lk's best waiter priority in lk and raises the
+// holder's ps_priority and cfs_priority to its own; if the
+// holder waits for another sleeplock, the walk goes on to that
+// one's holder, PI_DEPTH locks deep at most. Only one lk->lk
+// is held at a time. Lower priority values are better.
+// Returns the pid of lk's holder it boosted, or 0.
+#define PI_DEPTH 8
+
+int pi_boost(struct sleeplock *lk)
+{
+  struct proc *w = myproc(), *p;
+  struct sleeplock *next;
+  int ps, cfs, pid, first = 0, depth;
+
+  acquire(&w->lock);
+  w->blocked_on = lk;
+  ps = w->ps_priority;
+  cfs = w->cfs_priority;
+  release(&w->lock);
+
+  for (depth = 0; lk && depth < PI_DEPTH; depth++)
+  {
+    acquire(&lk->lk);
+    pid = lk->pid;
+    if (!lk->locked || pid == w->pid)
+    {
+      release(&lk->lk);
+      break;
+    }
+    if (lk->ps_boost < 0 || ps < lk->ps_boost)
+      lk->ps_boost = ps;
+    if (lk->cfs_boost < 0 || cfs < lk->cfs_boost)
+      lk->cfs_boost = cfs;
+    // the holder cannot release lk, and so restore its
+    // priority, until we let go of lk->lk.
+    if ((p = pidlookup(pid)) == 0)
+    {
+      release(&lk->lk);
+      break;
+    }
+    if (depth == 0)
+      first = pid;
+    next = 0;
+    if (ps < p->ps_priority || cfs < p->cfs_priority)
+    {
+      if (ps < p->ps_priority)
+        p->ps_priority = ps;
+      if (cfs < p->cfs_priority)
+        p->cfs_priority = cfs;
+      next = p->blocked_on;
+    }
+    release(&p->lock);
+    release(&lk->lk);
+    lk = next;
+  }
+  return first;
+}
+
+// Set the caller's priorities back to what it chose, raised
+// only by the waiters of the sleeplocks it still holds.
+void pi_restore(void)
+{
+  struct proc *p = myproc();
+  struct sleeplock *lk;
+  int ps = p->ps_base, cfs = p->cfs_base;
+
+  acquire(&p->lock);
+  // a waiter sets lk's boost before it takes p->lock.
+  for (lk = p->held; lk; lk = lk->next_held)
+  {
+    if (lk->ps_boost >= 0 && lk->ps_boost < ps)
+      ps = lk->ps_boost;
+    if (lk->cfs_boost >= 0 && lk->cfs_boost < cfs)
+      cfs = lk->cfs_boost;
+  }
+  p->ps_priority = ps;
+  p->cfs_priority = cfs;
+  release(&p->lock);
+}
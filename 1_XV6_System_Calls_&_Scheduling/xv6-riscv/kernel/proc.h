@@ -19,6 +19,45 @@ struct context
   uint64 s11;
 };
 
+// A cfs process group's share of one hart's run queue.
+// The lock of that run queue must be held when using it.
+struct gsched
+{
+  struct rb_node node;  // Link in the run queue's tree of groups
+  struct rb_root tree;  // The group's processes queued here, by vruntime
+  int nr;               // Number of them
+  long long vruntime;   // Weighted run time of the group on this hart
+  uint64 seq;           // Enqueue order, breaks ties
+};
+
+// A cfs process group, see create_group().
+struct pgroup
+{
+  int nproc;              // Members, 0 if the group is free; group_lock
+  int weight;             // CPU share, GROUP_WEIGHT is the default; group_lock
+  struct gsched se[NCPU]; // State on each hart
+};
+
+// Per-CPU run queue of RUNNABLE processes waiting for this hart.
+// Which structure holds them depends on the scheduling policy.
+struct runq
+{
+  struct spinlock lock;
+  int id;              // Hart that owns this queue, or -1 for edf_rq
+  int nr;              // Number of queued processes
+  uint64 seq;          // Enqueue counter, breaks ties in arrival order
+  struct proc *head;   // default: queued in arrival order
+  struct proc *tail;
+  struct proc *mlfq_head[MLFQ_LEVELS]; // mlfq: one such list per level
+  struct proc *mlfq_tail[MLFQ_LEVELS];
+  uint mlfq_mask;      // mlfq: bit l set if level l is not empty
+  struct proc **heap[NHEAPDIR]; // ps, stride: min-heap on (accumulator or pass, seq), in pages
+  struct rb_root tree; // cfs: groups by vruntime; edf_rq: processes by deadline
+  long long min_vruntime; // cfs: vruntime of the last process dispatched
+  long long min_gvruntime; // cfs: vruntime of the last group dispatched
+  long long min_pass;  // stride: pass of the last process dispatched
+};
+
 // Per-CPU state.
 struct cpu
 {
@@ -26,6 +65,17 @@ struct cpu
   struct context context; // swtch() here to enter scheduler().
   int noff;               // Depth of push_off() nesting.
   int intena;             // Were interrupts enabled before push_off()?
+  struct runq rq;         // Processes waiting to run on this cpu.
+  uint last_balance;      // ticks at the last load balancing pass.
+  int idle;               // Waiting in wfi for something to run?
+  uint mlfq_epoch;        // mlfq: boost period of the last boost here
+  uint kstack_gen;        // kstack_gen when this hart last flushed its TLB
+  int need_resched;       // Should the running process yield at the next trap?
+  uint64 busy_cycles;     // r_time() cycles spent running processes
+  uint64 idle_cycles;     // cycles spent in wfi with nothing to run
+  uint64 irq_cycles;      // cycles spent handling interrupts
+  struct spinlock hr_lock; // guards hrtimers
+  struct proc *hrtimers;  // usleep() callers due here, by hr_deadline
 };
 
 extern struct cpu cpus[NCPU];
@@ -104,8 +154,35 @@ struct proc
   int xstate;           // Exit status to be returned to parent's wait
   int pid;              // Process ID
 
-  // wait_lock must be held when using this:
+  // ptable.lock must be held when using these:
+  struct proc *all_next; // Links in the live or free descriptor list
+  struct proc *all_prev;
+
+  // pid_lock must be held when using this:
+  struct proc *pid_next; // Next in the pid hash chain
+
+  // the lock of the sleep queue p->sq must be held when using these:
+  struct sleepq *sq;     // Sleep queue p is on, or 0
+  struct proc *sq_next;  // Links in the sleep queue
+  struct proc *sq_prev;
+
+  // timerwheel.lock must be held when using these:
+  uint wake_tick;        // Tick sleep_until() waits for
+  int tw_queued;         // On the timer wheel?
+  struct proc *tw_next;  // Links in the timer wheel slot
+  struct proc *tw_prev;
+  uint64 hr_deadline;    // r_time() usleep() waits for
+  struct proc *hr_next;  // Link in a hart's hrtimers
+
+  // parent->wait_lock must be held when using these:
   struct proc *parent; // Parent process
+  struct proc *sib_next; // Links in the parent's children or zombies
+  struct proc *sib_prev;
+
+  // wait_lock must be held when using these:
+  struct spinlock wait_lock;
+  struct proc *children; // Live children
+  struct proc *zombies;  // Exited children not yet waited for
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -123,5 +200,44 @@ struct proc
   int rtime;                   // Task6
   int stime;                   // Task6
   int retime;                  // Task6
-  
+  uint state_ticks;            // Task6: ticks when p entered its state
+  long long vruntime;          // Task6: weighted run time, see charge_tick()
+  uint64 cpumask;              // Harts p may run on, one bit per hart
+  int cpu;                     // Hart p last ran on
+  int slice_left;              // Ticks left in p's time slice, see charge_tick()
+  int group;                   // cfs group, see create_group()
+  long long gdelta;            // Group vruntime run up but not yet charged
+  int ps_base;                 // ps_priority and cfs_priority as set by p;
+  int cfs_base;                // they may be boosted above it, see pi_boost()
+  struct sleeplock *blocked_on; // Sleeplock p waits for, or 0; p->lock
+  struct sleeplock *held;      // Sleeplocks p holds, linked by next_held
+  int tickets;                 // stride: share of the CPU, see set_tickets()
+  int donated;                 // stride: tickets lent to p; p->lock
+  long long pass;              // stride: see charge_tick()
+  int lent_to;                 // pid p lent its tickets to, or 0
+  int lent;                    // How many it lent
+  int mlfq_level;              // mlfq: queue level, 0 is the highest
+  int mlfq_used;               // mlfq: ticks used of this level's allotment
+  uint mlfq_epoch;             // mlfq: boost period mlfq_level was set in
+
+  // EDF class, see set_edf(); p->lock must be held when using these:
+  int edf_runtime;             // Ticks of CPU per period, 0 if not EDF
+  int edf_period;              // Ticks between job releases
+  int edf_deadline;            // Ticks from release to the job's deadline
+  int edf_budget;              // Runtime left to the current job
+  uint edf_release;            // ticks when the next job is released
+  uint edf_dl;                 // ticks at the current job's deadline
+  int edf_misses;              // Jobs still runnable at their deadline
+
+  // edf_lock must be held when using these:
+  uint64 edf_bw;               // Reserved bandwidth, see EDF_SHIFT
+  struct proc *edf_next;       // Link in the list of EDF processes
+
+  // the lock of the run queue p->rq must be held when using these:
+  struct runq *rq;             // Run queue p is waiting on, or 0
+  struct proc *rq_next;        // Links in the run queue's list
+  struct proc *rq_prev;
+  struct rb_node rq_node;      // Link in the cfs group's or edf_rq's tree
+  int heap_idx;                // Slot in the run queue's ps heap
+  uint64 rq_seq;               // Enqueue order, breaks ties
 };
@@ -0,0 +1,18 @@
+// Process statistics, one record per live process,
+// as returned by the get_procs() system call.
+struct pstat {
+  int pid;
+  int state;              // enum procstate, see kernel/proc.h
+  int ps_priority;
+  int cfs_priority;
+  long long accumulator;
+  int tickets;            // stride tickets
+  int rtime;              // ticks spent running
+  int stime;              // ticks spent sleeping
+  int retime;             // ticks spent runnable
+  uint64 sz;              // size of process memory (bytes)
+  int edf_runtime;        // EDF ticks per period, 0 if not EDF
+  int edf_period;
+  int edf_misses;         // EDF jobs that missed their deadline
+  char name[16];
+};
@@ -0,0 +1,256 @@
+// Red-black trees, used by the scheduler's run queues.
+//
+// The tree is intrusive: callers embed a struct rb_node in
+// their own objects and recover the object with rb_entry().
+// The tree does no locking and no allocation; the caller
+// protects it with whatever lock guards the containing queue.
+//
+// Equal keys are allowed. A node that compares equal to nodes
+// already in the tree is placed after them, so callers that
+// break ties with an insertion sequence number get FIFO order.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "rbtree.h"
+#include "defs.h"
+
+static void
+rb_set_child(struct rb_root *root, struct rb_node *parent,
+             struct rb_node *old, struct rb_node *new)
+{
+  if(parent == 0)
+    root->node = new;
+  else if(parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+static void
+rb_rotate_left(struct rb_root *root, struct rb_node *x)
+{
+  struct rb_node *y = x->right;
+
+  x->right = y->left;
+  if(y->left)
+    y->left->parent = x;
+  y->parent = x->parent;
+  rb_set_child(root, x->parent, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+static void
+rb_rotate_right(struct rb_root *root, struct rb_node *x)
+{
+  struct rb_node *y = x->left;
+
+  x->left = y->right;
+  if(y->right)
+    y->right->parent = x;
+  y->parent = x->parent;
+  rb_set_child(root, x->parent, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+static int
+rb_is_red(struct rb_node *n)
+{
+  return n != 0 && n->red;
+}
+
+// Return the in-order successor of n, or 0 if n is the last node.
+struct rb_node*
+rb_next(struct rb_node *n)
+{
+  if(n->right){
+    n = n->right;
+    while(n->left)
+      n = n->left;
+    return n;
+  }
+  while(n->parent && n == n->parent->right)
+    n = n->parent;
+  return n->parent;
+}
+
+// Return the smallest node in the tree, or 0 if it is empty.
+struct rb_node*
+rb_first(struct rb_root *root)
+{
+  return root->leftmost;
+}
+
+// Insert n into the tree. less(a, b) returns non-zero if
+// a sorts strictly before b.
+void
+rb_insert(struct rb_root *root, struct rb_node *n,
+          int (*less)(struct rb_node *, struct rb_node *))
+{
+  struct rb_node **link = &root->node;
+  struct rb_node *parent = 0;
+  struct rb_node *g, *u;
+  int leftmost = 1;
+
+  while(*link){
+    parent = *link;
+    if(less(n, parent)){
+      link = &parent->left;
+    } else {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+  n->parent = parent;
+  n->left = n->right = 0;
+  n->red = 1;
+  *link = n;
+  if(leftmost)
+    root->leftmost = n;
+
+  // restore the red-black properties.
+  while((parent = n->parent) != 0 && parent->red){
+    g = parent->parent;
+    if(parent == g->left){
+      u = g->right;
+      if(rb_is_red(u)){
+        parent->red = 0;
+        u->red = 0;
+        g->red = 1;
+        n = g;
+        continue;
+      }
+      if(n == parent->right){
+        rb_rotate_left(root, parent);
+        n = parent;
+        parent = n->parent;
+      }
+      parent->red = 0;
+      g->red = 1;
+      rb_rotate_right(root, g);
+    } else {
+      u = g->left;
+      if(rb_is_red(u)){
+        parent->red = 0;
+        u->red = 0;
+        g->red = 1;
+        n = g;
+        continue;
+      }
+      if(n == parent->left){
+        rb_rotate_right(root, parent);
+        n = parent;
+        parent = n->parent;
+      }
+      parent->red = 0;
+      g->red = 1;
+      rb_rotate_left(root, g);
+    }
+  }
+  root->node->red = 0;
+}
+
+// Remove n from the tree. n must be in the tree.
+void
+rb_erase(struct rb_root *root, struct rb_node *n)
+{
+  struct rb_node *x, *xp, *y, *w;
+  int removed_red;
+
+  if(root->leftmost == n)
+    root->leftmost = rb_next(n);
+
+  if(n->left == 0 || n->right == 0){
+    // n has at most one child; splice it out.
+    x = n->left ? n->left : n->right;
+    xp = n->parent;
+    removed_red = n->red;
+    rb_set_child(root, xp, n, x);
+    if(x)
+      x->parent = xp;
+  } else {
+    // replace n with its successor y, which has no left child.
+    y = n->right;
+    while(y->left)
+      y = y->left;
+    removed_red = y->red;
+    x = y->right;
+    if(y->parent == n){
+      xp = y;
+    } else {
+      xp = y->parent;
+      xp->left = x;
+      if(x)
+        x->parent = xp;
+      y->right = n->right;
+      y->right->parent = y;
+    }
+    rb_set_child(root, n->parent, n, y);
+    y->parent = n->parent;
+    y->left = n->left;
+    y->left->parent = y;
+    y->red = n->red;
+  }
+
+  if(removed_red)
+    return;
+
+  // a black node was removed; x carries an extra black.
+  while(x != root->node && !rb_is_red(x)){
+    if(x == xp->left){
+      w = xp->right;
+      if(w->red){
+        w->red = 0;
+        xp->red = 1;
+        rb_rotate_left(root, xp);
+        w = xp->right;
+      }
+      if(!rb_is_red(w->left) && !rb_is_red(w->right)){
+        w->red = 1;
+        x = xp;
+        xp = x->parent;
+      } else {
+        if(!rb_is_red(w->right)){
+          w->left->red = 0;
+          w->red = 1;
+          rb_rotate_right(root, w);
+          w = xp->right;
+        }
+        w->red = xp->red;
+        xp->red = 0;
+        w->right->red = 0;
+        rb_rotate_left(root, xp);
+        x = root->node;
+      }
+    } else {
+      w = xp->left;
+      if(w->red){
+        w->red = 0;
+        xp->red = 1;
+        rb_rotate_right(root, xp);
+        w = xp->left;
+      }
+      if(!rb_is_red(w->left) && !rb_is_red(w->right)){
+        w->red = 1;
+        x = xp;
+        xp = x->parent;
+      } else {
+        if(!rb_is_red(w->left)){
+          w->right->red = 0;
+          w->red = 1;
+          rb_rotate_left(root, w);
+          w = xp->left;
+        }
+        w->red = xp->red;
+        xp->red = 0;
+        w->left->red = 0;
+        rb_rotate_right(root, xp);
+        x = root->node;
+      }
+    }
+  }
+  if(x)
+    x->red = 0;
+}
@@ -0,0 +1,18 @@
+// Intrusive red-black tree.
+// The node is embedded in the object being sorted; the
+// caller supplies the ordering when inserting.
+struct rb_node {
+  struct rb_node *parent;
+  struct rb_node *left;
+  struct rb_node *right;
+  int red;                  // 1 if red, 0 if black
+};
+
+struct rb_root {
+  struct rb_node *node;     // Root of the tree, or 0 if empty
+  struct rb_node *leftmost; // Cached minimum, or 0 if empty
+};
+
+// Return the object that contains the rb_node ptr.
+#define rb_entry(ptr, type, member) \
+  ((type *)((char *)(ptr) - (uint64)&((type *)0)->member))
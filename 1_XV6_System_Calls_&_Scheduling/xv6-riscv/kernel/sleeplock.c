@@ -6,6 +6,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rbtree.h"
 #include "proc.h"
 #include "sleeplock.h"
 
@@ -16,28 +17,68 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->ps_boost = -1;
+  lk->cfs_boost = -1;
+  lk->next_held = 0;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  int boosted;
+
   acquire(&lk->lk);
   while (lk->locked) {
+    // raise the holder, and whoever it waits for, to our
+    // priority. pi_boost() takes lk->lk itself, so the lock
+    // may change hands meanwhile; boost the new holder too.
+    // If pi_boost() found no holder to boost (0), just sleep;
+    // retrying would spin on lk->lk.
+    release(&lk->lk);
+    boosted = pi_boost(lk);
+    acquire(&lk->lk);
+    if (!lk->locked || (boosted != 0 && lk->pid != boosted))
+      continue;
+    // lend the holder our stride tickets until we wake.
+    lend_tickets(lk->pid);
     sleep(lk, &lk->lk);
+    return_tickets();
   }
   lk->locked = 1;
-  lk->pid = myproc()->pid;
+  lk->pid = p->pid;
+  lk->next_held = p->held;
+  p->held = lk;
+  acquire(&p->lock);
+  p->blocked_on = 0;
+  release(&p->lock);
   release(&lk->lk);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  struct sleeplock **pp;
+
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
+  // the waiters boost the next holder once they wake.
+  lk->ps_boost = -1;
+  lk->cfs_boost = -1;
   wakeup(lk);
   release(&lk->lk);
+
+  for (pp = &p->held; *pp; pp = &(*pp)->next_held) {
+    if (*pp == lk) {
+      *pp = lk->next_held;
+      break;
+    }
+  }
+  lk->next_held = 0;
+  // drop the boost lk's waiters gave us.
+  pi_restore();
 }
 
 int
@@ -6,5 +6,10 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // Priority inheritance, see pi_boost(); guarded by lk:
+  int ps_boost;      // Best ps_priority of a waiter, or -1
+  int cfs_boost;     // Best cfs_priority of a waiter, or -1
+  struct sleeplock *next_held; // Next lock the holder holds
 };
 
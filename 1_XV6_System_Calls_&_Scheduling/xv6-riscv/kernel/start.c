@@ -11,7 +11,7 @@ void timerinit();
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
 // a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+uint64 timer_scratch[NCPU][TIMER_SCRATCH];
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -46,6 +46,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let supervisor mode read the time CSR, for r_time().
+  w_mcounteren(r_mcounteren() | 2);
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -66,16 +69,27 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  int interval = TICK_CYCLES; // cycles; about 1/10th second in qemu.
+  uint64 next = *(uint64*)CLINT_MTIME + interval;
+  *(uint64*)CLINT_MTIMECMP(id) = next;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
   // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[5] : address of CLINT MSIP register.
+  // scratch[6] : set when a timer interrupt is forwarded; see devintr().
+  // scratch[7] : time of the next periodic timer interrupt.
+  // scratch[8] : one-shot deadline, -1 if none; see hrtimer_arm().
+  // scratch[9] : set when the one-shot deadline passes.
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
   scratch[4] = interval;
+  scratch[5] = CLINT_MSIP(id);
+  scratch[6] = 0;
+  scratch[7] = next;
+  scratch[8] = -1;
+  scratch[9] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -84,6 +98,7 @@ timerinit()
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer interrupts, and software
+  // interrupts, which other harts send as IPIs.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
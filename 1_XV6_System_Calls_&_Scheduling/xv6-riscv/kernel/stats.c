@@ -0,0 +1,90 @@
+//
+// System load accounting.
+//
+// Each hart counts the r_time() cycles it spends running
+// processes, idle in wfi and handling interrupts, in its
+// struct cpu (see scheduler(), cpu_idle() and trap.c).
+// clockintr() calls load_tick() on every tick, which every
+// LOAD_FREQ ticks folds the number of RUNNABLE and RUNNING
+// processes into exponentially decayed 1, 5 and 15 minute
+// load averages, as Unix has always done.
+//
+// Reading the stats device returns a struct sysstat.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "trace.h"
+#include "stats.h"
+#include "defs.h"
+
+#define LOAD_FREQ (5 * TRACE_TIMEBASE / TICK_CYCLES) // ticks between updates: 5 s
+#define EXP_1   1884  // FIXED_1/exp(5s/1min)
+#define EXP_5   2014  // FIXED_1/exp(5s/5min)
+#define EXP_15  2037  // FIXED_1/exp(5s/15min)
+
+// written only by hart 0, from clockintr(); readers take
+// each average as it is.
+uint64 loadavg[3];
+int load_count = LOAD_FREQ;
+
+// Decay load towards active by a factor of e/FIXED_1.
+static uint64
+calc_load(uint64 load, uint64 e, uint64 active)
+{
+  uint64 n = load * e + active * (FIXED_1 - e);
+
+  // round up while rising, so a steady load is reached.
+  if(active >= load)
+    n += FIXED_1 - 1;
+  return n >> FSHIFT;
+}
+
+void
+load_tick(void)
+{
+  uint64 active;
+
+  if(--load_count > 0)
+    return;
+  load_count = LOAD_FREQ;
+
+  active = (uint64)nr_running() * FIXED_1;
+  loadavg[0] = calc_load(loadavg[0], EXP_1, active);
+  loadavg[1] = calc_load(loadavg[1], EXP_5, active);
+  loadavg[2] = calc_load(loadavg[2], EXP_15, active);
+}
+
+// Copy a snapshot, or as much of it as fits in n bytes, to dst.
+// Returns the number of bytes copied.
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  struct sysstat st;
+
+  memset(&st, 0, sizeof(st));
+  st.time = r_time();
+  st.ticks = ticks;
+  st.loadavg[0] = loadavg[0];
+  st.loadavg[1] = loadavg[1];
+  st.loadavg[2] = loadavg[2];
+  procstats(&st);
+
+  if(n > sizeof(st))
+    n = sizeof(st);
+  if(either_copyout(user_dst, dst, &st, n) < 0)
+    return -1;
+  return n;
+}
+
+void
+statsinit(void)
+{
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = 0;
+}
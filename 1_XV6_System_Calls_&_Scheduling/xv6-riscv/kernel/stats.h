@@ -0,0 +1,25 @@
+// System load and per-hart utilisation, as read from the
+// stats device. Each read returns a fresh snapshot.
+
+#define FSHIFT  11              // bits of fraction in a load average
+#define FIXED_1 (1 << FSHIFT)   // 1.0 as a load average
+
+struct cpustat {
+  uint64 busy;    // r_time() cycles spent running processes
+  uint64 idle;    // cycles spent in wfi with nothing to run
+  uint64 irq;     // cycles spent handling interrupts
+  int online;     // has the hart entered scheduler()?
+  int nr;         // processes waiting on its run queue
+  int pid;        // process it is running, 0 if none
+  int pad;
+};
+
+struct sysstat {
+  uint64 time;          // r_time() when the snapshot was taken
+  uint64 loadavg[3];    // 1, 5 and 15 minute load averages, FSHIFT fixed point
+  uint ticks;
+  int nproc;            // live processes
+  int nrunning;         // RUNNABLE or RUNNING processes
+  int ncpu;             // entries in cpu[]
+  struct cpustat cpu[NCPU];
+};
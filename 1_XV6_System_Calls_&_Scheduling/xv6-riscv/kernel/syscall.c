@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rbtree.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
@@ -102,6 +103,14 @@ extern uint64 sys_set_ps_priority(void);
 extern uint64 sys_set_cfs_priority(void);
 extern uint64 sys_get_cfs_priority(void);
 extern uint64 sys_set_policy(void);
+extern uint64 sys_set_affinity(void);
+extern uint64 sys_get_affinity(void);
+extern uint64 sys_get_procs(void);
+extern uint64 sys_set_edf(void);
+extern uint64 sys_usleep(void);
+extern uint64 sys_create_group(void);
+extern uint64 sys_set_group_weight(void);
+extern uint64 sys_set_tickets(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -132,6 +141,14 @@ static uint64 (*syscalls[])(void) = {
     [SYS_set_cfs_priority] sys_set_cfs_priority,
     [SYS_get_cfs_priority] sys_get_cfs_priority,
     [SYS_set_policy] sys_set_policy,
+    [SYS_set_affinity] sys_set_affinity,
+    [SYS_get_affinity] sys_get_affinity,
+    [SYS_get_procs] sys_get_procs,
+    [SYS_set_edf] sys_set_edf,
+    [SYS_usleep] sys_usleep,
+    [SYS_create_group] sys_create_group,
+    [SYS_set_group_weight] sys_set_group_weight,
+    [SYS_set_tickets] sys_set_tickets,
 
 };
 
@@ -24,4 +24,12 @@
 #define SYS_set_ps_priority 23
 #define SYS_set_cfs_priority 24
 #define SYS_get_cfs_priority 25
-#define SYS_set_policy 26
\ No newline at end of file
+#define SYS_set_policy 26
+#define SYS_set_affinity 27
+#define SYS_get_affinity 28
+#define SYS_get_procs 29
+#define SYS_set_edf 30
+#define SYS_usleep 31
+#define SYS_create_group 32
+#define SYS_set_group_weight 33
+#define SYS_set_tickets 34
\ No newline at end of file
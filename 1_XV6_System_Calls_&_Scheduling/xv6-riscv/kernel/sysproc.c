@@ -4,6 +4,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rbtree.h"
 #include "proc.h"
 
 uint64
@@ -56,22 +57,21 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while (ticks - ticks0 < n)
-  {
-    if (killed(myproc()))
-    {
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return sleep_ticks(n);
+}
+
+// sleep for at least a number of microseconds.
+uint64
+sys_usleep(void)
+{
+  int n;
+
+  argint(0, &n);
+  if (n < 0)
+    return -1;
+  return usleep(n);
 }
 
 uint64
@@ -139,7 +139,85 @@ sys_set_policy(void)
 {
   int n;
   argint(0, &n);
-  if (n == 0 || n == 1 || n == 2)
+  if (n >= 0 && n < NPOLICY)
     return set_policy(n);
   return -1;
-}
\ No newline at end of file
+}
+
+// set the mask of harts a process may run on.
+// pid 0 means the calling process.
+uint64
+sys_set_affinity(void)
+{
+  int pid, mask;
+  argint(0, &pid);
+  argint(1, &mask);
+  return set_affinity(pid, (uint)mask);
+}
+
+// return the mask of harts a process may run on, or -1.
+uint64
+sys_get_affinity(void)
+{
+  int pid;
+  uint64 mask;
+  argint(0, &pid);
+  if (get_affinity(pid, &mask) < 0)
+    return -1;
+  return mask;
+}
+
+// fill a user array of struct pstat with one record per
+// live process; returns the number of records.
+uint64
+sys_get_procs(void)
+{
+  uint64 buf;
+  int n;
+  argaddr(0, &buf);
+  argint(1, &n);
+  return get_procs(buf, n);
+}
+
+// make the caller an EDF process needing runtime ticks
+// of CPU every period ticks, by deadline ticks into the
+// period (0: the period). runtime 0 leaves the EDF class.
+uint64
+sys_set_edf(void)
+{
+  int runtime, period, deadline;
+  argint(0, &runtime);
+  argint(1, &period);
+  argint(2, &deadline);
+  return set_edf(runtime, period, deadline);
+}
+
+// create a cfs group of the given weight (1024: default, and
+// at most the caller's group's) and move the caller into it;
+// returns the group id.
+uint64
+sys_create_group(void)
+{
+  int weight;
+  argint(0, &weight);
+  return create_group(weight);
+}
+
+// set the weight of the caller's cfs group (at most 1024).
+uint64
+sys_set_group_weight(void)
+{
+  int g, weight;
+  argint(0, &g);
+  argint(1, &weight);
+  return set_group_weight(g, weight);
+}
+
+// set the caller's stride tickets (100: default).
+uint64
+sys_set_tickets(void)
+{
+  int n;
+  argint(0, &n);
+  return set_tickets(n);
+}
@@ -0,0 +1,103 @@
+//
+// Scheduler event tracing.
+//
+// Each hart records events into its own ring buffer, with
+// interrupts off and without taking any lock, so tracing adds
+// no contention to the scheduler. When a ring is full the
+// oldest events are overwritten.
+//
+// Reading the schedtrace device drains the rings. Readers are
+// serialized by tracelock; a reader discards any event whose
+// slot the writer may have reused while it was being copied.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "trace.h"
+#include "defs.h"
+
+#define TRACE_SIZE 512 // events per hart
+
+struct tracering {
+  struct traceevent ev[TRACE_SIZE];
+  uint64 head;   // events ever written; only its hart writes it
+  uint64 tail;   // events consumed by readers; tracelock
+  uint64 lost;   // events overwritten before being read; tracelock
+};
+
+struct tracering tracerings[NCPU];
+struct spinlock tracelock;
+
+// Record an event in this hart's ring.
+void
+tracerecord(int type, int pid, int policy, long long key, int arg)
+{
+  struct tracering *r;
+  struct traceevent *e;
+
+  push_off();
+  r = &tracerings[cpuid()];
+  e = &r->ev[r->head % TRACE_SIZE];
+  e->time = r_time();
+  e->key = key;
+  e->type = type;
+  e->pid = pid;
+  e->cpu = cpuid();
+  e->policy = policy;
+  e->arg = arg;
+  // the event must be complete before a reader can see it.
+  __sync_synchronize();
+  r->head++;
+  pop_off();
+}
+
+// Copy up to n bytes of whole events to dst, oldest first
+// within each hart. Returns the number of bytes copied.
+int
+traceread(int user_dst, uint64 dst, int n)
+{
+  struct tracering *r;
+  struct traceevent e;
+  uint64 head;
+  int copied = 0;
+
+  acquire(&tracelock);
+  for(r = tracerings; r < &tracerings[NCPU]; r++){
+    head = r->head;
+    __sync_synchronize();
+    if(head - r->tail >= TRACE_SIZE){
+      r->lost += head - r->tail - (TRACE_SIZE - 1);
+      r->tail = head - (TRACE_SIZE - 1);
+    }
+    while(r->tail < head && n - copied >= (int)sizeof(e)){
+      e = r->ev[r->tail % TRACE_SIZE];
+      __sync_synchronize();
+      if(r->head - r->tail >= TRACE_SIZE){
+        // the writer lapped us while we copied.
+        r->lost++;
+        r->tail++;
+        continue;
+      }
+      if(either_copyout(user_dst, dst + copied, &e, sizeof(e)) < 0)
+        goto out;
+      copied += sizeof(e);
+      r->tail++;
+    }
+  }
+out:
+  release(&tracelock);
+  return copied;
+}
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+  devsw[SCHEDTRACE].read = traceread;
+  devsw[SCHEDTRACE].write = 0;
+}
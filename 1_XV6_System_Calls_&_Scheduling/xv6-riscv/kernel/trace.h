@@ -0,0 +1,19 @@
+// Scheduler trace events, as read from the schedtrace device.
+
+#define TRACE_SWITCHIN  1 // a hart started running pid
+#define TRACE_SWITCHOUT 2 // pid gave up its hart; arg is 1 if still RUNNABLE
+#define TRACE_WAKEUP    3 // pid was woken up and queued
+#define TRACE_FORK      4 // pid was created and queued
+#define TRACE_EXIT      5 // pid exited
+
+#define TRACE_TIMEBASE 10000000 // r_time() ticks per second in qemu
+
+struct traceevent {
+  uint64 time;    // r_time() when the event happened
+  long long key;  // vruntime under cfs, accumulator otherwise
+  int type;       // TRACE_*
+  int pid;
+  short cpu;      // hart that recorded the event
+  short policy;   // scheduling policy in force
+  int arg;
+};
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "rbtree.h"
 #include "proc.h"
 #include "defs.h"
 
@@ -15,6 +16,11 @@ extern char trampoline[], uservec[], userret[];
 void kernelvec();
 
 extern int devintr();
+static int timed_devintr();
+
+// in start.c; timervec sets [6] when it forwards a timer interrupt,
+// and [9] when this hart's one-shot deadline has passed.
+extern uint64 timer_scratch[NCPU][TIMER_SCRATCH];
 
 void trapinit(void)
 {
@@ -64,7 +70,7 @@ void usertrap(void)
 
     syscall();
   }
-  else if ((which_dev = devintr()) != 0)
+  else if ((which_dev = timed_devintr()) != 0)
   {
     // ok
   }
@@ -78,13 +84,11 @@ void usertrap(void)
   if (killed(p))
     exit(-1, "");
 
-  // give up the CPU if this is a timer interrupt.
-  if (which_dev == 2)
-  {
-    // update_timers();
-    p->accumulator = p->accumulator + p->ps_priority; // added line for Task5
+  // give up the CPU if this is a timer interrupt and
+  // the policy says p's time is up, or if a wakeup asked
+  // this hart to run something better.
+  if ((which_dev == 2 && charge_tick(p)) || need_resched())
     yield();
-  }
 
   usertrapret();
 }
@@ -148,21 +152,19 @@ void kerneltrap()
   if (intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
-  if ((which_dev = devintr()) == 0)
+  if ((which_dev = timed_devintr()) == 0)
   {
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if (which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-  {
-    struct proc *p = myproc();
-    // update_timers();
-    p->accumulator = p->accumulator + p->ps_priority; // added line for Task5
+  // give up the CPU if this is a timer interrupt and
+  // the policy says p's time is up, or if a wakeup asked
+  // this hart to run something better.
+  if (myproc() != 0 && myproc()->state == RUNNING &&
+      ((which_dev == 2 && charge_tick(myproc())) || need_resched()))
     yield();
-  }
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -174,9 +176,21 @@ void clockintr()
 {
   acquire(&tickslock);
   ticks++;
-  update_timers();
-  wakeup(&ticks);
   release(&tickslock);
+  timer_tick();
+  edf_tick();
+  load_tick();
+}
+
+// devintr(), charging the cycles it takes to this hart's
+// irq_cycles. Interrupts are off, so we stay on this hart.
+static int timed_devintr()
+{
+  uint64 start = r_time();
+  int which_dev = devintr();
+
+  mycpu()->irq_cycles += r_time() - start;
+  return which_dev;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -219,18 +233,26 @@ int devintr()
   }
   else if (scause == 0x8000000000000001L)
   {
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
+
+    // acknowledge the software interrupt by clearing
+    // the SSIP bit in sip.
+    w_sip(r_sip() & ~2);
+
+    if (__sync_lock_test_and_set(&timer_scratch[cpuid()][9], 0))
+      hrtimer_intr();
+
+    // an IPI only has to end a wfi in scheduler(), which
+    // taking the interrupt has done.
+    if (__sync_lock_test_and_set(&timer_scratch[cpuid()][6], 0) == 0)
+      return 1;
 
     if (cpuid() == 0)
     {
       clockintr();
     }
 
-    // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
-    w_sip(r_sip() & ~2);
-
     return 2;
   }
   else
@@ -0,0 +1,111 @@
+// edf: run CPU-bound EDF tasks next to CPU hogs and report
+// each task's deadline misses.
+//
+//   edf [-d ticks] [-h nhogs] runtime:period[:deadline] ...
+//
+// Each task is a child that asks set_edf() for the given
+// reservation and then spins for the whole run, so every job
+// wants its full budget. The hogs are ordinary processes under
+// the current policy. After the run (default 200 ticks) the
+// EDF fields of get_procs() are printed for each task; with
+// admission control a task should never miss a deadline.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/pstat.h"
+#include "user/user.h"
+
+#define MAXTASKS 16
+#define MAXPS    64 // get_procs() records read back
+
+struct pstat ps[MAXPS];
+int pids[MAXTASKS + MAXPS];
+int npids;
+
+volatile uint64 sink;
+
+void
+spin(int end)
+{
+  int i;
+
+  while(uptime() < end)
+    for(i = 0; i < 10000; i++)
+      sink = sink * 31 + i;
+}
+
+// Parse "a:b[:c]" into v[0..2]; a missing c is 0.
+int
+parse(char *s, int *v)
+{
+  int i;
+
+  for(i = 0; i < 3; i++){
+    v[i] = atoi(s);
+    while(*s >= '0' && *s <= '9')
+      s++;
+    if(*s != ':')
+      break;
+    s++;
+  }
+  if(i < 1)
+    return -1;
+  if(i < 2)
+    v[2] = 0;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ticks = 200, nhogs = 0, ntasks = 0, end, i, j, n, pid;
+  int spec[MAXTASKS][3];
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+      ticks = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-h") == 0 && i + 1 < argc)
+      nhogs = atoi(argv[++i]);
+    else if(ntasks < MAXTASKS && parse(argv[i], spec[ntasks]) == 0)
+      ntasks++;
+    else {
+      fprintf(2, "usage: edf [-d ticks] [-h nhogs] runtime:period[:deadline] ...\n");
+      exit(1, "");
+    }
+  }
+
+  end = uptime() + ticks;
+  for(i = 0; i < ntasks + nhogs && npids < MAXTASKS + MAXPS; i++){
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "edf: fork failed\n");
+      break;
+    }
+    if(pid == 0){
+      if(i < ntasks && set_edf(spec[i][0], spec[i][1], spec[i][2]) < 0){
+        printf("edf: %d:%d:%d not admitted\n", spec[i][0], spec[i][1], spec[i][2]);
+        exit(1, "");
+      }
+      spin(end + 100);
+      exit(0, "");
+    }
+    pids[npids++] = pid;
+  }
+
+  sleep(end - uptime());
+  n = get_procs(ps, MAXPS);
+  printf("pid\truntime\tperiod\trtime\tmisses\n");
+  for(i = 0; i < ntasks && i < npids; i++){
+    for(j = 0; j < n && ps[j].pid != pids[i]; j++)
+      ;
+    if(j < n && ps[j].edf_runtime > 0)
+      printf("%d\t%d\t%d\t%d\t%d\n", ps[j].pid, ps[j].edf_runtime,
+             ps[j].edf_period, ps[j].rtime, ps[j].edf_misses);
+  }
+
+  for(i = 0; i < npids; i++)
+    kill(pids[i]);
+  for(i = 0; i < npids; i++)
+    wait(0, 0);
+  exit(0, "");
+}
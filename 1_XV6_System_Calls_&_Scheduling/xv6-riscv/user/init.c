@@ -23,6 +23,10 @@ int main(void)
   dup(0); // stdout
   dup(0); // stderr
 
+  // fails harmlessly if it already exists.
+  mknod("schedtrace", SCHEDTRACE, 0);
+  mknod("stats", STATS, 0);
+
   for (;;)
   {
     printf("init: starting sh\n");
@@ -17,6 +17,10 @@ int main(int argc, char *argv[])
             exit(0, "Changed policy to ps\n");
         case 2:
             exit(0, "Changed policy to cfs\n");
+        case 3:
+            exit(0, "Changed policy to mlfq\n");
+        case 4:
+            exit(0, "Changed policy to stride\n");
         default:
             break;
         }
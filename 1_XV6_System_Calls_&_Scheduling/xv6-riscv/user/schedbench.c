@@ -0,0 +1,287 @@
+// schedbench: compare the scheduling policies on a mixed workload.
+//
+//   schedbench [-c ncpu] [-i nio] [-x ninter] [-d ticks] [-m] [policy...]
+//
+// For each policy (default: 0 1 2 3 4) it switches to the policy with
+// set_policy(), runs the workers for the given number of ticks and
+// reports:
+//   throughput  work units done by the CPU-bound workers per tick
+//   fairness    Jain's index over the CPU-bound workers' work
+//   latency     p50/p99 wakeup-to-run time of the sleeping workers,
+//               taken from the schedtrace device
+//
+// Workers:
+//   cpu    spins on arithmetic for the whole run
+//   io     sleeps a tick, does a little work, repeats
+//   inter  sleeps 1-3 ticks, does a short burst, repeats
+// With -m the workers get mixed ps/cfs priorities and stride
+// tickets, cycling through (1, 0, 300), (5, 1, 200) and
+// (10, 2, 100); otherwise all use the defaults.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define MAXWORKERS 32
+#define MAXEV      (8*512)
+#define CHUNK      100000   // iterations per unit of CPU work
+
+enum { CPU, IO, INTER };
+char *kinds[] = { "cpu", "io", "inter" };
+
+struct result {
+  int pid;
+  int kind;
+  uint64 work;
+};
+
+struct result results[MAXWORKERS];
+int nresults;
+struct traceevent *ev, *tmp;
+int nev;
+uint64 lat[MAXEV];
+int nlat;
+
+volatile uint64 sink;
+
+void
+spin(int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    sink = sink * 31 + i;
+}
+
+// Body of one worker; runs until uptime() reaches end.
+uint64
+work(int kind, int end)
+{
+  uint64 done = 0;
+  uint seed = getpid();
+
+  while(uptime() < end){
+    switch(kind){
+    case CPU:
+      spin(CHUNK);
+      break;
+    case IO:
+      sleep(1);
+      spin(CHUNK / 100);
+      break;
+    case INTER:
+      seed = seed * 1103515245 + 12345;
+      sleep(1 + (seed >> 16) % 3);
+      spin(CHUNK / 10);
+      break;
+    }
+    done++;
+  }
+  return done;
+}
+
+void
+readevents(int fd)
+{
+  int n;
+
+  while(nev < MAXEV){
+    n = read(fd, (char*)&ev[nev], (MAXEV - nev) * sizeof(ev[0]));
+    if(n <= 0)
+      break;
+    nev += n / sizeof(ev[0]);
+  }
+}
+
+void
+sortevents(int lo, int hi)
+{
+  int mid, i, j, k;
+
+  if(hi - lo < 2)
+    return;
+  mid = (lo + hi) / 2;
+  sortevents(lo, mid);
+  sortevents(mid, hi);
+  i = lo;
+  j = mid;
+  for(k = lo; k < hi; k++){
+    if(j >= hi || (i < mid && ev[i].time <= ev[j].time))
+      tmp[k] = ev[i++];
+    else
+      tmp[k] = ev[j++];
+  }
+  memmove(&ev[lo], &tmp[lo], (hi - lo) * sizeof(ev[0]));
+}
+
+// Collect wakeup-to-switch-in latencies (us) of our workers.
+void
+latencies(void)
+{
+  uint64 woken[MAXWORKERS];
+  struct traceevent *e;
+  int i;
+
+  memset(woken, 0, sizeof(woken));
+  nlat = 0;
+  sortevents(0, nev);
+  for(e = ev; e < &ev[nev]; e++){
+    for(i = 0; i < nresults && results[i].pid != e->pid; i++)
+      ;
+    if(i == nresults)
+      continue;
+    if(e->type == TRACE_WAKEUP){
+      woken[i] = e->time;
+    } else if(e->type == TRACE_SWITCHIN && woken[i]){
+      lat[nlat++] = (e->time - woken[i]) / (TRACE_TIMEBASE / 1000000);
+      woken[i] = 0;
+    }
+  }
+  // insertion sort; the samples are mostly small and few.
+  for(i = 1; i < nlat; i++){
+    uint64 v = lat[i];
+    int j = i - 1;
+    while(j >= 0 && lat[j] > v){
+      lat[j + 1] = lat[j];
+      j--;
+    }
+    lat[j + 1] = v;
+  }
+}
+
+void
+run(int policy, int ncpu, int nio, int ninter, int ticks, int mixed)
+{
+  static int psprio[] = { 1, 5, 10 };
+  int fds[2], fd, pid, kind, n, i, end;
+  uint64 total = 0, sumsq = 0, fair100 = 0;
+  struct result r;
+
+  if(set_policy(policy) < 0){
+    printf("policy %d: set_policy failed\n", policy);
+    return;
+  }
+  if(pipe(fds) < 0 || (fd = open("/schedtrace", O_RDONLY)) < 0){
+    fprintf(2, "schedbench: cannot set up pipe or /schedtrace\n");
+    exit(1, "");
+  }
+  nev = 0;
+  readevents(fd);
+  nev = 0;
+
+  end = uptime() + ticks;
+  n = 0;
+  for(kind = CPU; kind <= INTER; kind++){
+    int count = kind == CPU ? ncpu : kind == IO ? nio : ninter;
+    for(i = 0; i < count; i++, n++){
+      pid = fork();
+      if(pid < 0){
+        fprintf(2, "schedbench: fork failed\n");
+        break;
+      }
+      if(pid == 0){
+        close(fds[0]);
+        if(mixed){
+          set_ps_priority(psprio[n % 3]);
+          set_cfs_priority(n % 3);
+          set_tickets(300 - 100 * (n % 3));
+        }
+        r.pid = getpid();
+        r.kind = kind;
+        r.work = work(kind, end);
+        write(fds[1], &r, sizeof(r));
+        exit(0, "");
+      }
+    }
+  }
+  close(fds[1]);
+  nresults = 0;
+  while(nresults < MAXWORKERS && read(fds[0], &results[nresults], sizeof(r)) == sizeof(r))
+    nresults++;
+  close(fds[0]);
+  while(wait(0, 0) > 0)
+    ;
+
+  readevents(fd);
+  close(fd);
+  latencies();
+
+  n = 0;
+  for(i = 0; i < nresults; i++){
+    if(results[i].kind != CPU)
+      continue;
+    total += results[i].work;
+    sumsq += results[i].work * results[i].work;
+    n++;
+  }
+  // Jain's index (sum x)^2 / (n * sum x^2), in hundredths.
+  if(n > 0 && sumsq > 0)
+    fair100 = (total * total * 100) / (n * sumsq);
+
+  printf("policy %d: throughput %l/tick  fairness ", policy, total / ticks);
+  if(fair100 >= 100)
+    printf("1.00");
+  else
+    printf("0.%d%d", (int)(fair100 / 10), (int)(fair100 % 10));
+  if(nlat > 0)
+    printf("  latency p50 %lus p99 %lus (%d wakeups)\n",
+           lat[nlat / 2], lat[nlat * 99 / 100], nlat);
+  else
+    printf("  latency n/a\n");
+  for(i = 0; i < nresults; i++)
+    printf("  pid %d %s: %l\n", results[i].pid, kinds[results[i].kind], results[i].work);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ncpu = 3, nio = 2, ninter = 2, ticks = 50, mixed = 0;
+  int npolicies = 0, policies[8];
+  int i;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+      ncpu = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+      nio = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-x") == 0 && i + 1 < argc)
+      ninter = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+      ticks = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-m") == 0)
+      mixed = 1;
+    else if(argv[i][0] >= '0' && argv[i][0] <= '9' && npolicies < 8)
+      policies[npolicies++] = atoi(argv[i]);
+    else {
+      fprintf(2, "usage: schedbench [-c ncpu] [-i nio] [-x ninter] [-d ticks] [-m] [policy...]\n");
+      exit(1, "");
+    }
+  }
+  if(ncpu + nio + ninter > MAXWORKERS || ticks <= 0){
+    fprintf(2, "schedbench: at most %d workers, and ticks > 0\n", MAXWORKERS);
+    exit(1, "");
+  }
+  if(npolicies == 0){
+    policies[npolicies++] = 0;
+    policies[npolicies++] = 1;
+    policies[npolicies++] = 2;
+    policies[npolicies++] = 3;
+    policies[npolicies++] = 4;
+  }
+
+  ev = malloc(MAXEV * sizeof(ev[0]));
+  tmp = malloc(MAXEV * sizeof(ev[0]));
+  if(ev == 0 || tmp == 0){
+    fprintf(2, "schedbench: out of memory\n");
+    exit(1, "");
+  }
+
+  printf("schedbench: %d cpu, %d io, %d inter, %d ticks%s\n",
+         ncpu, nio, ninter, ticks, mixed ? ", mixed priorities" : "");
+  for(i = 0; i < npolicies; i++)
+    run(policies[i], ncpu, nio, ninter, ticks, mixed);
+  set_policy(0);
+  exit(0, "");
+}
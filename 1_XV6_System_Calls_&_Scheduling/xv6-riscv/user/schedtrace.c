@@ -0,0 +1,236 @@
+// schedtrace: report what the scheduler did.
+//
+//   schedtrace [-t]            report the events buffered so far
+//   schedtrace [-t] cmd args   drop old events, run cmd, report
+//
+// Prints a histogram of run-queue latency (from a process being
+// queued to a hart switching to it) and a per-process summary.
+// With -t, also prints each process's events in time order.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define MAXEV   (8*512) // NCPU rings of TRACE_SIZE events
+#define MAXPID  128     // processes summarized
+#define NBUCKET 16      // histogram buckets, powers of two of us
+
+struct pstat {
+  int pid;
+  int nswitch;       // times switched in
+  int nqueued;       // latencies measured
+  uint64 runtime;    // time spent switched in
+  uint64 latsum;     // total run-queue latency
+  uint64 latmax;
+  uint64 lastin;     // time of the last switch in, or 0
+  uint64 queued;     // time it was last queued, or 0
+};
+
+struct traceevent *ev, *tmp;
+int nev;
+struct pstat pstats[MAXPID];
+int npstat;
+uint64 hist[NBUCKET];
+
+char *names[] = {
+  [TRACE_SWITCHIN]  "switch-in",
+  [TRACE_SWITCHOUT] "switch-out",
+  [TRACE_WAKEUP]    "wakeup",
+  [TRACE_FORK]      "fork",
+  [TRACE_EXIT]      "exit",
+};
+
+uint64
+us(uint64 t)
+{
+  return t / (TRACE_TIMEBASE / 1000000);
+}
+
+// Read every buffered event from the device into ev[].
+void
+readevents(int fd)
+{
+  int n;
+
+  while(nev < MAXEV){
+    n = read(fd, (char*)&ev[nev], (MAXEV - nev) * sizeof(ev[0]));
+    if(n <= 0)
+      break;
+    nev += n / sizeof(ev[0]);
+  }
+}
+
+// The device returns each hart's events in order, one hart
+// after another; merge sort them into a single timeline.
+void
+sortevents(int lo, int hi)
+{
+  int mid, i, j, k;
+
+  if(hi - lo < 2)
+    return;
+  mid = (lo + hi) / 2;
+  sortevents(lo, mid);
+  sortevents(mid, hi);
+  i = lo;
+  j = mid;
+  for(k = lo; k < hi; k++){
+    if(j >= hi || (i < mid && ev[i].time <= ev[j].time))
+      tmp[k] = ev[i++];
+    else
+      tmp[k] = ev[j++];
+  }
+  memmove(&ev[lo], &tmp[lo], (hi - lo) * sizeof(ev[0]));
+}
+
+struct pstat*
+lookup(int pid)
+{
+  int i;
+
+  for(i = 0; i < npstat; i++)
+    if(pstats[i].pid == pid)
+      return &pstats[i];
+  if(npstat == MAXPID)
+    return 0;
+  memset(&pstats[npstat], 0, sizeof(pstats[0]));
+  pstats[npstat].pid = pid;
+  return &pstats[npstat++];
+}
+
+void
+account(struct traceevent *e)
+{
+  struct pstat *s;
+  uint64 lat;
+  int b;
+
+  if((s = lookup(e->pid)) == 0)
+    return;
+  switch(e->type){
+  case TRACE_SWITCHIN:
+    s->nswitch++;
+    s->lastin = e->time;
+    if(s->queued){
+      lat = us(e->time - s->queued);
+      s->latsum += lat;
+      s->nqueued++;
+      if(lat > s->latmax)
+        s->latmax = lat;
+      for(b = 0; b < NBUCKET - 1 && lat >= (2UL << b); b++)
+        ;
+      hist[b]++;
+      s->queued = 0;
+    }
+    break;
+  case TRACE_SWITCHOUT:
+    if(s->lastin)
+      s->runtime += e->time - s->lastin;
+    s->lastin = 0;
+    if(e->arg)
+      s->queued = e->time;
+    break;
+  case TRACE_WAKEUP:
+  case TRACE_FORK:
+    s->queued = e->time;
+    break;
+  }
+}
+
+void
+report(int timeline)
+{
+  struct pstat *s;
+  struct traceevent *e;
+  uint64 max = 0;
+  int i, j;
+
+  printf("%d events\n", nev);
+  if(nev == 0)
+    return;
+
+  printf("\nrun-queue latency (us)\n");
+  for(i = 0; i < NBUCKET; i++)
+    if(hist[i] > max)
+      max = hist[i];
+  for(i = 0; i < NBUCKET; i++){
+    if(i == NBUCKET - 1)
+      printf("%l+\t%l\t", 1UL << i, hist[i]);
+    else
+      printf("%l-%l\t%l\t", i == 0 ? 0 : 1UL << i, (2UL << i) - 1, hist[i]);
+    for(j = 0; max && j < (hist[i] * 40 + max - 1) / max; j++)
+      printf("*");
+    printf("\n");
+  }
+
+  printf("\npid\tswitches\trun(us)\tavg lat\tmax lat\n");
+  for(s = pstats; s < &pstats[npstat]; s++){
+    printf("%d\t%d\t\t%l\t%l\t%l\n", s->pid, s->nswitch, us(s->runtime),
+           s->nqueued ? s->latsum / s->nqueued : 0, s->latmax);
+  }
+
+  if(!timeline)
+    return;
+  for(s = pstats; s < &pstats[npstat]; s++){
+    printf("\npid %d\n", s->pid);
+    for(e = ev; e < &ev[nev]; e++){
+      if(e->pid != s->pid)
+        continue;
+      printf("  +%l\tcpu %d\t%s\tpolicy %d\tkey %d\n",
+             us(e->time - ev[0].time), e->cpu,
+             e->type > 0 && e->type <= TRACE_EXIT ? names[e->type] : "?",
+             e->policy, (int)e->key);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, pid, timeline = 0;
+  int i;
+
+  if(argc > 1 && strcmp(argv[1], "-t") == 0){
+    timeline = 1;
+    argc--;
+    argv++;
+  }
+
+  if((fd = open("/schedtrace", O_RDONLY)) < 0){
+    fprintf(2, "schedtrace: cannot open /schedtrace\n");
+    exit(1, "");
+  }
+  ev = malloc(MAXEV * sizeof(ev[0]));
+  tmp = malloc(MAXEV * sizeof(ev[0]));
+  if(ev == 0 || tmp == 0){
+    fprintf(2, "schedtrace: out of memory\n");
+    exit(1, "");
+  }
+
+  if(argc > 1){
+    // throw away what happened before the command.
+    readevents(fd);
+    nev = 0;
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "schedtrace: fork failed\n");
+      exit(1, "");
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "schedtrace: exec %s failed\n", argv[1]);
+      exit(1, "");
+    }
+    wait(0, 0);
+  }
+
+  readevents(fd);
+  close(fd);
+  sortevents(0, nev);
+  for(i = 0; i < nev; i++)
+    account(&ev[i]);
+  report(timeline);
+  exit(0, "");
+}
@@ -0,0 +1,169 @@
+// top: show how busy each hart is and what is running.
+//
+//   top [-n count] [-d ticks]
+//
+// Every d ticks (default 10) it reads the stats device and
+// get_procs() and prints:
+//   the load averages, and the live and running process counts
+//   for each hart, the share of the interval it spent running
+//     processes, idle and in interrupts, its run-queue length
+//     and the process it is running
+//   the processes that ran most during the interval
+// It runs until killed, or for count screens with -n.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/pstat.h"
+#include "kernel/stats.h"
+#include "user/user.h"
+
+#define MAXPS 64 // get_procs() records read back
+#define NTOP  10 // processes listed
+
+struct pstat ps[MAXPS], prevps[MAXPS];
+int nps, nprevps;
+int delta[MAXPS]; // ticks ps[i] ran in the interval
+
+char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+// Print a FSHIFT fixed-point number with two decimals.
+void
+printfixed(uint64 v)
+{
+  v = (v * 100 + FIXED_1 / 2) >> FSHIFT;
+  printf("%d.%d%d", (int)(v / 100), (int)(v / 10 % 10), (int)(v % 10));
+}
+
+// Print n/total as a percentage, right-aligned in 4 columns.
+void
+printpct(uint64 n, uint64 total)
+{
+  int pct = total ? (n * 100 + total / 2) / total : 0;
+
+  if(pct > 100)
+    pct = 100;
+  printf("%s%d%%", pct < 10 ? "  " : pct < 100 ? " " : "", pct);
+}
+
+int
+readstats(int fd, struct sysstat *st)
+{
+  return read(fd, (char*)st, sizeof(*st)) == sizeof(*st) ? 0 : -1;
+}
+
+// Work out delta[] from the previous get_procs() records.
+void
+rtimes(void)
+{
+  int i, j;
+
+  for(i = 0; i < nps; i++){
+    for(j = 0; j < nprevps && prevps[j].pid != ps[i].pid; j++)
+      ;
+    delta[i] = ps[i].rtime - (j < nprevps ? prevps[j].rtime : 0);
+  }
+}
+
+void
+show(struct sysstat *st, struct sysstat *prev)
+{
+  struct cpustat *c, *pc;
+  uint64 busy, idle, irq, total;
+  int i, j, best, shown;
+
+  printf("\033[H\033[J");
+  printf("up %d ticks, %d processes, %d running, load average: ",
+         st->ticks, st->nproc, st->nrunning);
+  printfixed(st->loadavg[0]);
+  printf(" ");
+  printfixed(st->loadavg[1]);
+  printf(" ");
+  printfixed(st->loadavg[2]);
+  printf("\n\nhart  busy  idle   irq  queued  pid\n");
+  for(i = 0; i < st->ncpu && i < NCPU; i++){
+    c = &st->cpu[i];
+    pc = &prev->cpu[i];
+    if(!c->online)
+      continue;
+    busy = c->busy - pc->busy;
+    idle = c->idle - pc->idle;
+    irq = c->irq - pc->irq;
+    // time not in any of them went on the scheduler itself.
+    total = st->time - prev->time;
+    printf("%d    ", i);
+    printpct(busy, total);
+    printf("  ");
+    printpct(idle, total);
+    printf("  ");
+    printpct(irq, total);
+    printf("  %d       ", c->nr);
+    if(c->pid)
+      printf("%d", c->pid);
+    printf("\n");
+  }
+
+  printf("\npid   state   ticks  rtime  name\n");
+  rtimes();
+  for(shown = 0; shown < NTOP; shown++){
+    best = -1;
+    for(j = 0; j < nps; j++)
+      if(delta[j] >= 0 && (best < 0 || delta[j] > delta[best]))
+        best = j;
+    if(best < 0)
+      break;
+    printf("%d\t%s\t%d\t%d\t%s\n", ps[best].pid,
+           ps[best].state >= 0 && ps[best].state <= 5 ? states[ps[best].state] : "?",
+           delta[best], ps[best].rtime, ps[best].name);
+    delta[best] = -1;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysstat st, prev;
+  int count = -1, interval = 10, fd, i;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      count = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+      interval = atoi(argv[++i]);
+    else {
+      fprintf(2, "usage: top [-n count] [-d ticks]\n");
+      exit(1, "");
+    }
+  }
+  if(interval <= 0){
+    fprintf(2, "top: ticks must be > 0\n");
+    exit(1, "");
+  }
+
+  if((fd = open("/stats", O_RDONLY)) < 0){
+    fprintf(2, "top: cannot open /stats\n");
+    exit(1, "");
+  }
+  if(readstats(fd, &prev) < 0){
+    fprintf(2, "top: short read from /stats\n");
+    exit(1, "");
+  }
+  if((nprevps = get_procs(prevps, MAXPS)) < 0)
+    nprevps = 0;
+  while(count != 0){
+    sleep(interval);
+    if(readstats(fd, &st) < 0)
+      break;
+    if((nps = get_procs(ps, MAXPS)) < 0)
+      nps = 0;
+    show(&st, &prev);
+    prev = st;
+    memmove(prevps, ps, nps * sizeof(ps[0]));
+    nprevps = nps;
+    if(count > 0)
+      count--;
+  }
+  close(fd);
+  exit(0, "");
+}
@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 
 struct stat;
+struct pstat;
 
 // system calls
 int fork(void);
@@ -29,6 +30,14 @@ void set_ps_priority(int);
 int set_cfs_priority(int);
 int get_cfs_priority(int, uint64);
 int set_policy(int);
+int set_affinity(int, int);
+int get_affinity(int);
+int get_procs(struct pstat *, int);
+int set_edf(int, int, int);
+int usleep(int);
+int create_group(int);
+int set_group_weight(int, int);
+int set_tickets(int);
 
 // ulib.c
 int stat(const char *, struct stat *);
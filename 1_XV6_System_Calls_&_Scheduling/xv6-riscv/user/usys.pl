@@ -40,4 +40,12 @@ entry("memsize");
 entry("set_ps_priority");
 entry("set_cfs_priority");
 entry("get_cfs_priority");
-entry("set_policy");
\ No newline at end of file
+entry("set_policy");
+entry("set_affinity");
+entry("get_affinity");
+entry("get_procs");
+entry("set_edf");
+entry("usleep");
+entry("create_group");
+entry("set_group_weight");
+entry("set_tickets");
\ No newline at end of file
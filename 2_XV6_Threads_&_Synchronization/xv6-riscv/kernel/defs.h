@@ -113,6 +113,16 @@ int kthread_id(void);
 int kthread_kill(int);
 void kthread_exit(int status);
 int kthread_join(int ktid, uint64 status);
+void setrunnable(struct kthread *);
+void unqueue(struct kthread *);
+int set_fairness(int);
+
+// futex.c
+void futexinit(void);
+int futex_wait(uint64, int, int);
+int futex_wake(uint64, int);
+void futex_tick(void);
+void futex_cancel(struct kthread *);
 
 // kthread.c
 void kthreadinit(struct proc *);
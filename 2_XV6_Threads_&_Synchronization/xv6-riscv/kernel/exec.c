@@ -121,7 +121,7 @@ int exec(char *path, char **argv)
       if (kt->k_state != K_UNUSED && kt->k_killed == 0)
         kt->k_killed = 1;
       if (kt->k_state == K_SLEEPING)
-        kt->k_state = K_RUNNABLE;
+        setrunnable(kt);
       release(&kt->k_lock);
     }
   }
@@ -0,0 +1,194 @@
+//
+// Futexes: sleep until a word of user memory changes.
+//
+// A thread in futex_wait() sits on one of NFUTEXQ queues,
+// chosen by hashing its process's page table and the user
+// address, so threads of one process that wait on the same
+// word meet on the same queue and futex_wake() only looks at
+// that queue. The word is compared under the queue's lock,
+// which futex_wake() also takes, so a wakeup between the
+// comparison and the sleep cannot be lost.
+// lock order: futex queue lock, then kt->k_lock.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define FUTEXQ_SHIFT 6
+#define NFUTEXQ (1 << FUTEXQ_SHIFT)
+
+struct futexq {
+  struct spinlock lock;
+  struct kthread *head;   // waiters, linked by f_next
+} futexq[NFUTEXQ];
+
+// waiters with a timeout, so futex_tick() can skip the scan.
+int futex_ntimed;
+
+static struct futexq *
+futex_hash(pagetable_t pt, uint64 uaddr)
+{
+  uint64 key = (uint64)pt ^ uaddr;
+
+  // Fibonacci hashing of the key's high-order bits.
+  return &futexq[(key * 0x9E3779B97F4A7C15UL) >> (64 - FUTEXQ_SHIFT)];
+}
+
+// Take kt off q. q->lock must be held.
+static void
+futex_unlink(struct futexq *q, struct kthread *kt)
+{
+  struct kthread **pp;
+
+  for(pp = &q->head; *pp; pp = &(*pp)->f_next){
+    if(*pp == kt){
+      *pp = kt->f_next;
+      break;
+    }
+  }
+  kt->f_next = 0;
+}
+
+// Make kt RUNNABLE if it is still asleep on q.
+// q->lock must be held.
+static void
+futex_wakeone(struct futexq *q, struct kthread *kt)
+{
+  acquire(&kt->k_lock);
+  if(kt->k_state == K_SLEEPING && kt->k_chan == q)
+    setrunnable(kt);
+  release(&kt->k_lock);
+}
+
+void
+futexinit(void)
+{
+  struct futexq *q;
+
+  for(q = futexq; q < &futexq[NFUTEXQ]; q++)
+    initlock(&q->lock, "futex");
+}
+
+// If the int at uaddr holds expected, sleep until futex_wake()
+// on uaddr, or, if timeout > 0, for at most timeout ticks.
+// Returns 0 when woken, -1 if *uaddr != expected, on timeout,
+// if the thread is killed or if uaddr is bad.
+int
+futex_wait(uint64 uaddr, int expected, int timeout)
+{
+  struct proc *p = myproc();
+  struct kthread *kt = mykthread();
+  struct futexq *q;
+  int val, r = -1;
+
+  if(uaddr % sizeof(int) != 0)
+    return -1;
+  q = futex_hash(p->pagetable, uaddr);
+
+  acquire(&q->lock);
+  if(copyin(p->pagetable, (char *)&val, uaddr, sizeof(val)) < 0 || val != expected){
+    release(&q->lock);
+    return -1;
+  }
+
+  kt->f_pt = p->pagetable;
+  kt->f_addr = uaddr;
+  kt->f_woken = 0;
+  kt->f_deadline = 0;
+  if(timeout > 0){
+    kt->f_deadline = ticks + timeout;
+    __sync_fetch_and_add(&futex_ntimed, 1);
+  }
+  kt->f_next = q->head;
+  q->head = kt;
+
+  // kill(), exit() and exec() make a sleeping thread RUNNABLE
+  // whatever it sleeps on, so look again each time.
+  for(;;){
+    if(kt->f_woken){
+      r = 0;
+      break;
+    }
+    if(killedForThread(kt) || (timeout > 0 && (int)(ticks - kt->f_deadline) >= 0)){
+      futex_unlink(q, kt);
+      break;
+    }
+    sleep(q, &q->lock);
+  }
+  if(timeout > 0)
+    __sync_fetch_and_sub(&futex_ntimed, 1);
+  kt->f_pt = 0;
+  release(&q->lock);
+  return r;
+}
+
+// Take kt off the futex queue it waits on, if any. Called when
+// kt is freed, since a thread asleep in futex_wait() may be freed
+// without running again. kt->k_lock must not be held.
+void
+futex_cancel(struct kthread *kt)
+{
+  struct futexq *q;
+
+  if(kt->f_pt == 0)
+    return;
+  q = futex_hash(kt->f_pt, kt->f_addr);
+  acquire(&q->lock);
+  futex_unlink(q, kt);
+  if(kt->f_deadline)
+    __sync_fetch_and_sub(&futex_ntimed, 1);
+  kt->f_pt = 0;
+  release(&q->lock);
+}
+
+// Wake up to n threads of this process waiting on uaddr.
+// Returns the number woken.
+int
+futex_wake(uint64 uaddr, int n)
+{
+  struct proc *p = myproc();
+  struct futexq *q = futex_hash(p->pagetable, uaddr);
+  struct kthread **pp, *kt;
+  int woken = 0;
+
+  acquire(&q->lock);
+  for(pp = &q->head; (kt = *pp) != 0 && woken < n; ){
+    if(kt->f_pt != p->pagetable || kt->f_addr != uaddr){
+      pp = &kt->f_next;
+      continue;
+    }
+    *pp = kt->f_next;
+    kt->f_next = 0;
+    kt->f_woken = 1;
+    futex_wakeone(q, kt);
+    woken++;
+  }
+  release(&q->lock);
+  return woken;
+}
+
+// Called on every clock tick: wake the waiters whose timeout
+// has expired, which then take themselves off their queue.
+void
+futex_tick(void)
+{
+  struct futexq *q;
+  struct kthread *kt;
+
+  if(futex_ntimed == 0)
+    return;
+  for(q = futexq; q < &futexq[NFUTEXQ]; q++){
+    if(q->head == 0)
+      continue;
+    acquire(&q->lock);
+    for(kt = q->head; kt; kt = kt->f_next)
+      if(kt->f_deadline && (int)(ticks - kt->f_deadline) >= 0)
+        futex_wakeone(q, kt);
+    release(&q->lock);
+  }
+}
@@ -44,7 +44,7 @@ int alloc_kt_id(struct proc *p)
 
 // Look in the threads table for an UNUSED thread.
 // If found, initialize state required to run in the kernel,
-// and return with kt->klock held.
+// and return with kt->k_lock held.
 // If there are no unused threads, or a memory allocation fails, return 0.
 struct kthread *allockthread(struct proc *p)
 {
@@ -76,9 +76,15 @@ struct kthread *allockthread(struct proc *p)
 
 // free a kthread structure and the data hanging from it,
 // including user pages.
-// kt->klock must be held.
+// kt->k_lock must not be held; it is taken here, after kt is
+// off any futex queue (queue locks come before k_lock), so that
+// no wakeup can queue kt while it is being freed.
 void freekthread(struct kthread *kt)
 {
+  futex_cancel(kt);
+  acquire(&kt->k_lock);
+  if (kt->rq)
+    unqueue(kt);
   kt->trapframe = 0;
   kt->k_tid = 0;
   kt->k_chan = 0;
@@ -87,6 +93,7 @@ void freekthread(struct kthread *kt)
   kt->k_myproc = 0;
   kt->k_state = K_UNUSED;
   memset(&kt->context, 0, sizeof(kt->context));
+  release(&kt->k_lock);
 }
 
 struct trapframe *get_kthread_trapframe(struct proc *p, struct kthread *kt)
@@ -82,6 +82,30 @@ struct context
   uint64 s11;
 };
 
+// A process's RUNNABLE threads queued on one hart, under
+// per-process fairness. The hart's rq.lock must be held when
+// using these.
+struct pqueue
+{
+  struct kthread *head;      // Threads in arrival order
+  struct kthread *tail;
+  struct pqueue *next;       // Link in the hart's list of processes
+  struct pqueue *prev;
+  int nr;                    // Number of threads queued
+};
+
+// Per-CPU run queue of RUNNABLE threads waiting for this hart.
+struct runq
+{
+  struct spinlock lock;
+  int id;                    // Hart that owns this queue
+  int nr;                    // Number of queued threads
+  struct kthread *head;      // per-thread fairness: threads in arrival order
+  struct kthread *tail;
+  struct pqueue *phead;      // per-process fairness: processes in turn
+  struct pqueue *ptail;
+};
+
 // Per-CPU state.
 struct cpu
 {
@@ -89,6 +113,7 @@ struct cpu
   struct context context;   // swtch() here to enter scheduler().
   int noff;                 // Depth of push_off() nesting.
   int intena;               // Were interrupts enabled before push_off()?
+  struct runq rq;           // Threads waiting to run on this cpu.
 };
 
 extern struct cpu cpus[NCPU];
@@ -98,7 +123,7 @@ struct kthread
 {
   struct spinlock k_lock;
 
-  // k->klock must be held when using these:
+  // kt->k_lock must be held when using these:
   enum kthreadstate k_state; // Kernel state
   void *k_chan;              // If non-zero, sleeping on chan - a pointer that can be used to wake up the thread in case it is sleeping on it
   int k_killed;              // If non-zero, have been killed
@@ -111,4 +136,16 @@ struct kthread
   uint64 kstack;               // Virtual address of kernel stack
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
+
+  // the run queue's lock must be held when using these:
+  struct runq *rq;             // Run queue kt waits on, or 0
+  struct kthread *rq_next;     // Link in the run queue, or in its process's pqueue
+  struct kthread *rq_prev;
+
+  // futex_wait(); the futex queue's lock must be held when using these:
+  struct kthread *f_next;      // Next waiter on the queue
+  pagetable_t f_pt;            // Page table and user address waited on
+  uint64 f_addr;
+  int f_woken;                 // Set by futex_wake()
+  uint f_deadline;             // ticks at the timeout, or 0
 };
\ No newline at end of file
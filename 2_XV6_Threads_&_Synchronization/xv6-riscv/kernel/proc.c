@@ -26,6 +26,253 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// RUNNABLE threads wait on per-CPU run queues, so dispatch
+// takes the front of this hart's queue instead of scanning
+// every thread of every process. A thread is queued on the
+// hart that makes it RUNNABLE; a hart whose queue is empty
+// takes work from the busiest one.
+// Under per-thread fairness a queue is one FIFO of threads.
+// Under per-process fairness it is a round-robin list of
+// processes, each with a FIFO of its threads, so a hart is
+// shared among processes however many threads each has.
+// lock order: kt->k_lock, then rq->lock. Only set_fairness()
+// holds more than one rq->lock, and takes them in cpus[] order.
+int per_process_fairness;
+struct spinlock fairness_lock;
+
+static void
+kt_append(struct kthread **head, struct kthread **tail, struct kthread *kt)
+{
+  kt->rq_next = 0;
+  kt->rq_prev = *tail;
+  if (*tail)
+    (*tail)->rq_next = kt;
+  else
+    *head = kt;
+  *tail = kt;
+}
+
+static void
+kt_remove(struct kthread **head, struct kthread **tail, struct kthread *kt)
+{
+  if (kt->rq_prev)
+    kt->rq_prev->rq_next = kt->rq_next;
+  else
+    *head = kt->rq_next;
+  if (kt->rq_next)
+    kt->rq_next->rq_prev = kt->rq_prev;
+  else
+    *tail = kt->rq_prev;
+  kt->rq_next = kt->rq_prev = 0;
+}
+
+static void
+pq_append(struct runq *rq, struct pqueue *pq)
+{
+  pq->next = 0;
+  pq->prev = rq->ptail;
+  if (rq->ptail)
+    rq->ptail->next = pq;
+  else
+    rq->phead = pq;
+  rq->ptail = pq;
+}
+
+static void
+pq_remove(struct runq *rq, struct pqueue *pq)
+{
+  if (pq->prev)
+    pq->prev->next = pq->next;
+  else
+    rq->phead = pq->next;
+  if (pq->next)
+    pq->next->prev = pq->prev;
+  else
+    rq->ptail = pq->prev;
+  pq->next = pq->prev = 0;
+}
+
+// kt's process's pqueue on the hart that owns rq.
+static struct pqueue *
+kt_pqueue(struct runq *rq, struct kthread *kt)
+{
+  return &kt->k_myproc->pq[rq->id];
+}
+
+// Add kt to the back of rq. rq->lock must be held.
+static void
+rq_insert(struct runq *rq, struct kthread *kt)
+{
+  struct pqueue *pq;
+
+  if (per_process_fairness)
+  {
+    pq = kt_pqueue(rq, kt);
+    kt_append(&pq->head, &pq->tail, kt);
+    if (pq->nr++ == 0)
+      pq_append(rq, pq);
+  }
+  else
+  {
+    kt_append(&rq->head, &rq->tail, kt);
+  }
+  kt->rq = rq;
+  rq->nr++;
+}
+
+// rq->lock must be held.
+static void
+rq_remove(struct runq *rq, struct kthread *kt)
+{
+  struct pqueue *pq;
+
+  if (per_process_fairness)
+  {
+    pq = kt_pqueue(rq, kt);
+    kt_remove(&pq->head, &pq->tail, kt);
+    if (--pq->nr == 0)
+      pq_remove(rq, pq);
+  }
+  else
+  {
+    kt_remove(&rq->head, &rq->tail, kt);
+  }
+  kt->rq = 0;
+  rq->nr--;
+}
+
+// Take the thread to run next off rq, or return 0 if it is
+// empty. Under per-process fairness its process goes to the
+// back of the list. rq->lock must be held.
+static struct kthread *
+rq_pop(struct runq *rq)
+{
+  struct pqueue *pq;
+  struct kthread *kt;
+
+  if (per_process_fairness)
+  {
+    if ((pq = rq->phead) == 0)
+      return 0;
+    kt = pq->head;
+    rq_remove(rq, kt);
+    if (pq->nr > 0)
+    {
+      pq_remove(rq, pq);
+      pq_append(rq, pq);
+    }
+    return kt;
+  }
+  if ((kt = rq->head) != 0)
+    rq_remove(rq, kt);
+  return kt;
+}
+
+// Make kt RUNNABLE and queue it on this hart.
+// Caller must hold kt->k_lock.
+void setrunnable(struct kthread *kt)
+{
+  struct runq *rq;
+
+  kt->k_state = K_RUNNABLE;
+  if (kt->rq)
+    return;
+  push_off();
+  rq = &mycpu()->rq;
+  acquire(&rq->lock);
+  rq_insert(rq, kt);
+  release(&rq->lock);
+  pop_off();
+}
+
+// Take kt off the run queue it waits on, if any.
+// Caller must hold kt->k_lock.
+void unqueue(struct kthread *kt)
+{
+  struct runq *rq = kt->rq;
+
+  if (rq == 0)
+    return;
+  acquire(&rq->lock);
+  // a hart may have taken kt off the queue to run it meanwhile.
+  if (kt->rq == rq)
+    rq_remove(rq, kt);
+  release(&rq->lock);
+}
+
+// Take the thread hart c should run next: the front of its
+// own queue, else the front of the busiest other one.
+// Returns 0 if every queue is empty.
+static struct kthread *
+rq_pick(struct cpu *c)
+{
+  struct cpu *oc;
+  struct runq *rq = &c->rq;
+  struct kthread *kt;
+
+  // the counts are read without locks; they are only a hint.
+  if (rq->nr == 0)
+  {
+    rq = 0;
+    for (oc = cpus; oc < &cpus[NCPU]; oc++)
+      if (oc != c && oc->rq.nr > 0 && (rq == 0 || oc->rq.nr > rq->nr))
+        rq = &oc->rq;
+    if (rq == 0)
+      return 0;
+  }
+  acquire(&rq->lock);
+  kt = rq_pop(rq);
+  release(&rq->lock);
+  return kt;
+}
+
+// Share each hart among RUNNABLE threads (0) or among the
+// processes they belong to (1). Every run queue is rebuilt
+// while all of them are locked. Returns 0, or -1.
+int set_fairness(int per_process)
+{
+  struct kthread *queued[NCPU], *kt, *rev;
+  int i;
+
+  if (per_process != 0 && per_process != 1)
+    return -1;
+  acquire(&fairness_lock);
+  for (i = 0; i < NCPU; i++)
+    acquire(&cpus[i].rq.lock);
+
+  for (i = 0; i < NCPU; i++)
+  {
+    queued[i] = 0;
+    while ((kt = rq_pop(&cpus[i].rq)) != 0)
+    {
+      kt->rq_next = queued[i];
+      queued[i] = kt;
+    }
+  }
+  per_process_fairness = per_process;
+  for (i = 0; i < NCPU; i++)
+  {
+    // queued[i] is in reverse; rebuild in arrival order.
+    rev = 0;
+    while ((kt = queued[i]) != 0)
+    {
+      queued[i] = kt->rq_next;
+      kt->rq_next = rev;
+      rev = kt;
+    }
+    while ((kt = rev) != 0)
+    {
+      rev = kt->rq_next;
+      rq_insert(&cpus[i].rq, kt);
+    }
+  }
+
+  for (i = NCPU - 1; i >= 0; i--)
+    release(&cpus[i].rq.lock);
+  release(&fairness_lock);
+  return 0;
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -53,6 +300,12 @@ void procinit(void)
 
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  initlock(&fairness_lock, "fairness");
+  for (struct cpu *c = cpus; c < &cpus[NCPU]; c++)
+  {
+    initlock(&c->rq.lock, "runq");
+    c->rq.id = c - cpus;
+  }
   for (p = proc; p < &proc[NPROC]; p++)
   {
     initlock(&p->lock, "proc");
@@ -156,6 +409,12 @@ allocproc(void)
 static void
 freeproc(struct proc *p)
 {
+  // first, so that no futex waiter is left keyed on a page
+  // table a new process may be given.
+  for (struct kthread *kt = p->kthread; kt < &p->kthread[NKT]; kt++)
+  {
+    freekthread(kt);
+  }
   if (p->base_trapframes)
     kfree((void *)p->base_trapframes);
   p->base_trapframes = 0;
@@ -169,10 +428,6 @@ freeproc(struct proc *p)
   p->killed = 0;
   p->xstate = 0;
   p->state = P_UNUSED;
-  for (struct kthread *kt = p->kthread; kt < &p->kthread[NKT]; kt++)
-  {
-    freekthread(kt);
-  }
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -248,7 +503,7 @@ void userinit(void)
   // prepare for the very first "return" from kernel to user.
   p->kthread[0].trapframe->epc = 0;     // user program counter
   p->kthread[0].trapframe->sp = PGSIZE; // user stack pointer
-  p->kthread[0].k_state = K_RUNNABLE;
+  setrunnable(&p->kthread[0]);
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
@@ -298,6 +553,7 @@ int fork(void)
   // Copy user memory from parent to child.
   if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0)
   {
+    release(&np->kthread[0].k_lock);
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -328,7 +584,7 @@ int fork(void)
   acquire(&np->lock);
   acquire(&np->kthread[0].k_lock);
   np->parent = p;
-  np->kthread[0].k_state = K_RUNNABLE;
+  setrunnable(&np->kthread[0]);
   release(&np->kthread[0].k_lock);
   release(&np->lock);
   release(&wait_lock);
@@ -372,7 +628,7 @@ void exit(int status)
         if (kt->k_state != K_UNUSED && kt->k_killed == 0)
           kt->k_killed = 1;
         if (kt->k_state == K_SLEEPING)
-          kt->k_state = K_RUNNABLE;
+          setrunnable(kt);
         release(&kt->k_lock);
       }
     }
@@ -489,13 +745,14 @@ int wait(uint64 addr)
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
-//  - swtch to start running that process.
-//  - eventually that process transfers control
+//  - take the next thread off this CPU's run queue, or
+//    off the busiest other one if this one is empty.
+//  - swtch to start running that thread.
+//  - eventually that thread transfers control
 //    via swtch back to the scheduler.
 void scheduler(void)
 {
-  struct proc *p;
+  struct kthread *kt;
   struct cpu *c = mycpu();
 
   c->k_thread = 0;
@@ -504,28 +761,24 @@ void scheduler(void)
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for (p = proc; p < &proc[NPROC]; p++)
+    if ((kt = rq_pick(c)) == 0)
+      continue;
+
+    acquire(&kt->k_lock);
+    // kt may have been freed, or freed and queued again, since
+    // we took it off the queue; then it is not ours to run.
+    if (kt->k_state == K_RUNNABLE && kt->rq == 0 &&
+        kt->k_myproc && kt->k_myproc->state == P_USED)
     {
-      // acquire(&p->lock);
-      if (p->state == P_USED)
-      {
-        for (struct kthread *kt = p->kthread; kt < &p->kthread[NKT]; kt++)
-        {
-          acquire(&kt->k_lock);
-          if (kt->k_state == K_RUNNABLE)
-          {
-            // Switch to chosen kernel.  It is the process's job
-            // to release its lock and then reacquire it
-            // before jumping back to us.
-            kt->k_state = K_RUNNING;
-            c->k_thread = kt;
-            swtch(&c->context, &kt->context);
-            c->k_thread = 0;
-          }
-          release(&kt->k_lock);
-        }
-      }
+      // Switch to chosen kernel.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      kt->k_state = K_RUNNING;
+      c->k_thread = kt;
+      swtch(&c->context, &kt->context);
+      c->k_thread = 0;
     }
+    release(&kt->k_lock);
   }
 }
 
@@ -562,7 +815,7 @@ void yield(void)
   struct kthread *kt = mykthread();
 
   acquire(&kt->k_lock);
-  kt->k_state = K_RUNNABLE;
+  setrunnable(kt);
   sched();
   release(&kt->k_lock);
 }
@@ -631,7 +884,7 @@ void wakeup(void *chan)
       acquire(&kt->k_lock);
       if (kt != my_kt)
         if (kt->k_state == K_SLEEPING && kt->k_chan == chan)
-          kt->k_state = K_RUNNABLE;
+          setrunnable(kt);
       release(&kt->k_lock);
     }
   }
@@ -657,7 +910,7 @@ int kill(int pid)
         kt->k_killed = 1;
         if (kt->k_state == K_SLEEPING)
         {
-          kt->k_state = K_RUNNABLE;
+          setrunnable(kt);
         }
         release(&kt->k_lock);
       }
@@ -773,7 +1026,7 @@ int kthread_create(uint64 start_func, uint64 stack, uint stack_size)
   new_kt->trapframe->sp = stack + stack_size;
   new_kt->trapframe->a0 = 0;
   new_kt->k_myproc = p;
-  new_kt->k_state = K_RUNNABLE;
+  setrunnable(new_kt);
   int tid = new_kt->k_tid;
   release(&new_kt->k_lock);
   return tid;
@@ -808,7 +1061,7 @@ found:
   kt->k_killed = 1;
   if (kt->k_state == K_SLEEPING)
   {
-    kt->k_state = K_RUNNABLE;
+    setrunnable(kt);
   }
   release(&kt->k_lock);
   return 0;
@@ -22,6 +22,7 @@ struct proc
   int pid;                           // Process ID
   struct kthread kthread[NKT];       // kthread group table                          NEW
   struct trapframe *base_trapframes; // data page for trampolines                    NEW
+  struct pqueue pq[NCPU];            // threads queued on each hart, per-process fairness
 
   // wait_lock must be held when using this:
   struct proc *parent; // Parent process
@@ -102,6 +102,9 @@ extern uint64 sys_kthread_id(void);
 extern uint64 sys_kthread_kill(void);
 extern uint64 sys_kthread_exit(void);
 extern uint64 sys_kthread_join(void);
+extern uint64 sys_set_fairness(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -132,6 +135,9 @@ static uint64 (*syscalls[])(void) = {
     [SYS_kthread_kill] sys_kthread_kill,
     [SYS_kthread_exit] sys_kthread_exit,
     [SYS_kthread_join] sys_kthread_join,
+    [SYS_set_fairness] sys_set_fairness,
+    [SYS_futex_wait] sys_futex_wait,
+    [SYS_futex_wake] sys_futex_wake,
 
 };
 
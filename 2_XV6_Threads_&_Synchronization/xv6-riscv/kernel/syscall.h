@@ -25,3 +25,6 @@
 #define SYS_kthread_kill 24
 #define SYS_kthread_exit 25
 #define SYS_kthread_join 26
+#define SYS_set_fairness 27
+#define SYS_futex_wait 28
+#define SYS_futex_wake 29
@@ -133,3 +133,30 @@ uint64 sys_kthread_join(void)
   argaddr(1, &status);
   return kthread_join(thread_id, status);
 }
+
+// 0: share each hart among threads, 1: among processes.
+uint64 sys_set_fairness(void)
+{
+  int per_process;
+  argint(0, &per_process);
+  return set_fairness(per_process);
+}
+
+uint64 sys_futex_wait(void)
+{
+  uint64 addr;
+  int expected, timeout;
+  argaddr(0, &addr);
+  argint(1, &expected);
+  argint(2, &timeout);
+  return futex_wait(addr, expected, timeout);
+}
+
+uint64 sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+  argaddr(0, &addr);
+  argint(1, &n);
+  return futex_wake(addr, n);
+}
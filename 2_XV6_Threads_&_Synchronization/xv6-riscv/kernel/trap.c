@@ -171,6 +171,7 @@ void clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  futex_tick();
 }
 
 // check if it's an external interrupt or software interrupt,
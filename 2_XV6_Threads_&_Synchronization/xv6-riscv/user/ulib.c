@@ -145,3 +145,119 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+//
+// Mutex, condition variable and semaphore for kernel threads.
+// The fast paths are atomic instructions on user memory; only
+// a thread that must wait, or must wake a waiter, enters the
+// kernel, and a waiter sleeps in futex_wait() without using
+// the CPU.
+//
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  // mark the mutex as waited on, so unlock wakes us.
+  if(c != 2)
+    c = __sync_lock_test_and_set(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2, 0);
+    c = __sync_lock_test_and_set(&m->state, 2);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    // someone may be waiting.
+    __sync_lock_release(&m->state);
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+  c->waiters = 0;
+}
+
+// Atomically unlock m and wait for a signal, then lock m again.
+// As with any condition variable, wakeups may be spurious.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq;
+
+  __sync_fetch_and_add(&c->waiters, 1);
+  seq = c->seq;
+  mutex_unlock(m);
+  // returns at once if a signal came since we read seq.
+  futex_wait(&c->seq, seq, 0);
+  __sync_fetch_and_sub(&c->waiters, 1);
+
+  // others may have been woken with us; take m as contended.
+  while(__sync_lock_test_and_set(&m->state, 2) != 0)
+    futex_wait(&m->state, 2, 0);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if(c->waiters > 0)
+    futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  if(c->waiters > 0)
+    futex_wake(&c->seq, 0x7fffffff);
+}
+
+void
+sem_init(struct sem *s, int count)
+{
+  s->count = count;
+  s->waiters = 0;
+}
+
+void
+sem_wait(struct sem *s)
+{
+  int c;
+
+  for(;;){
+    c = s->count;
+    if(c > 0){
+      if(__sync_val_compare_and_swap(&s->count, c, c - 1) == c)
+        return;
+      continue;
+    }
+    __sync_fetch_and_add(&s->waiters, 1);
+    // returns at once if a post came since we read count.
+    futex_wait(&s->count, 0, 0);
+    __sync_fetch_and_sub(&s->waiters, 1);
+  }
+}
+
+void
+sem_post(struct sem *s)
+{
+  __sync_fetch_and_add(&s->count, 1);
+  if(s->waiters > 0)
+    futex_wake(&s->count, 1);
+}
@@ -27,6 +27,9 @@ int kthread_id(void);
 int kthread_kill(int);
 int kthread_exit(int);
 int kthread_join(int, uint64);
+int set_fairness(int);
+int futex_wait(int *, int, int);
+int futex_wake(int *, int);
 
 // ulib.c
 int stat(const char *, struct stat *);
@@ -44,3 +47,27 @@ void free(void *);
 int atoi(const char *);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// ulib.c: thread synchronization on futex_wait()/futex_wake().
+// An uncontended lock or post makes no system call.
+struct mutex {
+  int state;    // 0: unlocked, 1: locked, 2: locked and maybe waited on
+};
+struct cond {
+  int seq;      // bumped by every signal
+  int waiters;
+};
+struct sem {
+  int count;
+  int waiters;
+};
+void mutex_init(struct mutex *);
+void mutex_lock(struct mutex *);
+void mutex_unlock(struct mutex *);
+void cond_init(struct cond *);
+void cond_wait(struct cond *, struct mutex *);
+void cond_signal(struct cond *);
+void cond_broadcast(struct cond *);
+void sem_init(struct sem *, int);
+void sem_wait(struct sem *);
+void sem_post(struct sem *);
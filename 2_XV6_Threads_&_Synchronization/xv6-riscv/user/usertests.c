@@ -3036,6 +3036,201 @@ void klttest()
   free((void *)stack_b);
 }
 
+int futexword;
+
+void futexwait_start_func(void)
+{
+  // the second thread waits with a timeout, so futex_tick()
+  // walks the queue too.
+  futex_wait(&futexword, 0, kthread_id() % 2 ? 0 : 1000);
+  kthread_exit(0);
+}
+
+// exit a process while its threads are parked in futex_wait(),
+// then make the kernel walk the futex queues the freed threads
+// were on.
+void futexexit(char *s)
+{
+  for (int i = 0; i < 20; i++)
+  {
+    int pid = fork();
+    if (pid < 0)
+    {
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if (pid == 0)
+    {
+      for (int j = 0; j < 2; j++)
+      {
+        void *stack = malloc(MAX_STACK_SIZE);
+        if (kthread_create((void *(*)())futexwait_start_func, (uint64)stack, MAX_STACK_SIZE) <= 0)
+        {
+          printf("%s: kthread_create failed\n", s);
+          exit(1);
+        }
+      }
+      sleep(1);
+      exit(0);
+    }
+    int xstatus;
+    wait(&xstatus);
+    if (xstatus != 0)
+      exit(1);
+    futex_wake(&futexword, 1);
+  }
+  sleep(2);
+}
+
+#define SYNC_THREADS 4
+#define SYNC_ITERS 2000
+
+struct mutex sync_mutex;
+int sync_counter;
+
+void mutex_start_func(void)
+{
+  for (int i = 0; i < SYNC_ITERS; i++)
+  {
+    mutex_lock(&sync_mutex);
+    // a read-modify-write that loses updates unless the
+    // mutex excludes the other threads.
+    int v = sync_counter;
+    sync_counter = v + 1;
+    mutex_unlock(&sync_mutex);
+  }
+  kthread_exit(0);
+}
+
+// start n threads, running f and g in turn, wait for them
+// all, and free their stacks.
+void run_threads(char *s, void (*f)(void), void (*g)(void), int n)
+{
+  void *stacks[SYNC_THREADS];
+  int tids[SYNC_THREADS];
+
+  for (int i = 0; i < n; i++)
+  {
+    stacks[i] = malloc(MAX_STACK_SIZE);
+    tids[i] = kthread_create((void *(*)())(i % 2 ? g : f), (uint64)stacks[i], MAX_STACK_SIZE);
+    if (tids[i] <= 0)
+    {
+      printf("%s: kthread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for (int i = 0; i < n; i++)
+  {
+    if (kthread_join(tids[i], 0) != 0)
+    {
+      printf("%s: kthread_join failed\n", s);
+      exit(1);
+    }
+    free(stacks[i]);
+  }
+}
+
+// several threads increment a counter under one mutex.
+void mutextest(char *s)
+{
+  mutex_init(&sync_mutex);
+  sync_counter = 0;
+  run_threads(s, mutex_start_func, mutex_start_func, SYNC_THREADS);
+  if (sync_counter != SYNC_THREADS * SYNC_ITERS)
+  {
+    printf("%s: counter %d, expected %d\n", s, sync_counter, SYNC_THREADS * SYNC_ITERS);
+    exit(1);
+  }
+}
+
+// A bounded buffer shared by SYNC_THREADS / 2 producers and as
+// many consumers, guarded either by semaphores (pc_use_sem) or
+// by a mutex and two condition variables.
+#define PC_SLOTS 4
+#define PC_ITEMS 500
+
+int pc_use_sem;
+int pc_buf[PC_SLOTS];
+int pc_head, pc_tail, pc_count;
+int pc_sum, pc_taken;
+struct sem pc_empty, pc_full;
+struct cond pc_notempty, pc_notfull;
+
+void pc_put(int v)
+{
+  if (pc_use_sem)
+    sem_wait(&pc_empty);
+  mutex_lock(&sync_mutex);
+  while (!pc_use_sem && pc_count == PC_SLOTS)
+    cond_wait(&pc_notfull, &sync_mutex);
+  pc_buf[pc_tail] = v;
+  pc_tail = (pc_tail + 1) % PC_SLOTS;
+  pc_count++;
+  if (!pc_use_sem)
+    cond_signal(&pc_notempty);
+  mutex_unlock(&sync_mutex);
+  if (pc_use_sem)
+    sem_post(&pc_full);
+}
+
+void pc_get(void)
+{
+  if (pc_use_sem)
+    sem_wait(&pc_full);
+  mutex_lock(&sync_mutex);
+  while (!pc_use_sem && pc_count == 0)
+    cond_wait(&pc_notempty, &sync_mutex);
+  pc_sum += pc_buf[pc_head];
+  pc_head = (pc_head + 1) % PC_SLOTS;
+  pc_count--;
+  pc_taken++;
+  if (!pc_use_sem)
+    cond_signal(&pc_notfull);
+  mutex_unlock(&sync_mutex);
+  if (pc_use_sem)
+    sem_post(&pc_empty);
+}
+
+void producer_start_func(void)
+{
+  for (int i = 1; i <= PC_ITEMS; i++)
+    pc_put(i);
+  kthread_exit(0);
+}
+
+void consumer_start_func(void)
+{
+  for (int i = 0; i < PC_ITEMS; i++)
+    pc_get();
+  kthread_exit(0);
+}
+
+// producers and consumers pass items through a small buffer,
+// first over semaphores, then over condition variables.
+void prodcons(char *s)
+{
+  int n = SYNC_THREADS / 2;
+
+  for (pc_use_sem = 1; pc_use_sem >= 0; pc_use_sem--)
+  {
+    mutex_init(&sync_mutex);
+    sem_init(&pc_empty, PC_SLOTS);
+    sem_init(&pc_full, 0);
+    cond_init(&pc_notempty);
+    cond_init(&pc_notfull);
+    pc_head = pc_tail = pc_count = 0;
+    pc_sum = pc_taken = 0;
+    run_threads(s, producer_start_func, consumer_start_func, SYNC_THREADS);
+    if (pc_taken != n * PC_ITEMS || pc_count != 0 ||
+        pc_sum != n * PC_ITEMS * (PC_ITEMS + 1) / 2)
+    {
+      printf("%s: %s: took %d items summing %d, %d left\n", s,
+             pc_use_sem ? "sem" : "cond", pc_taken, pc_sum, pc_count);
+      exit(1);
+    }
+  }
+}
+
 struct test
 {
   void (*f)(char *);
@@ -3103,6 +3298,9 @@ struct test
     {badarg, "badarg"},
     {ulttest, "ulttest"},
     {klttest, "klttest"},
+    {futexexit, "futexexit"},
+    {mutextest, "mutextest"},
+    {prodcons, "prodcons"},
 
     {0, 0},
 };
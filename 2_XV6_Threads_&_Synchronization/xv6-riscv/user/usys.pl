@@ -41,4 +41,7 @@ entry("kthread_id");
 entry("kthread_kill");
 entry("kthread_exit");
 entry("kthread_join");
+entry("set_fairness");
+entry("futex_wait");
+entry("futex_wake");
 